@@ -10,6 +10,19 @@
 #include "BackendAllocators.h"
 #include "Unittest.h"
 
+#include <new> // bad_alloc
+#include <cstdlib> // posix_memalign, free
+#include <atomic>
+#include <cerrno>
+#ifdef _WIN32
+  #include <malloc.h> // _aligned_malloc
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+  #include <sys/mman.h> // mmap, munmap, madvise
+  #include <unistd.h> // sysconf
+  #define RG_HAS_MMAP
+#endif
+
 // ------------------------------------- Definitions -------------------------------------
 
 namespace rg_privateallocator
@@ -17,22 +30,219 @@ namespace rg_privateallocator
 
 //========================================================================================
 //________________________________________________________________________________________
-void* NewDeleteBackend::allocateRaw(size_t size) const
+void* NewDeleteBackend::allocateAlignedRaw(size_t size, size_t alignment)
+{
+  assert (alignment > 0 && (alignment & (alignment - 1)) == 0);
+  if (alignment < sizeof(void*))
+    alignment = sizeof(void*);
+
+  void* ret;
+  #ifdef _WIN32
+    ret = _aligned_malloc(size, alignment);
+  #else
+    if (posix_memalign(&ret, alignment, size) != 0)
+      ret = nullptr;
+  #endif
+  if (!ret)
+    throw std::bad_alloc();
+  return ret;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void NewDeleteBackend::deallocateAlignedRaw(void* b, size_t /*size*/)
+{
+  #ifdef _WIN32
+    _aligned_free(b);
+  #else
+    free(b);
+  #endif
+}
+
+//========================================================================================
+// NewDeleteBackend unittests
+//________________________________________________________________________________________
+void test_NewDeleteBackend()
+{
+  NewDeleteBackend nd;
+  void* b = nd.allocateRaw(10);
+  RG_EXPECT(b);
+  nd.deallocateRaw(b);
+
+  for (size_t alignment : {1u, 64u, 4096u, 128*1024u})
+  {
+    b = nd.allocateAlignedRaw(alignment, alignment);
+    RG_EXPECT(b && (size_t(b) & (alignment - 1)) == 0);
+    nd.deallocateAlignedRaw(b, alignment);
+  }
+}
+
+RG_ADD_UNITTEST2(test_NewDeleteBackend, 1);
+
+//========================================================================================
+// MallocBackend and BackendAdapter<> unittests
+//________________________________________________________________________________________
+void test_MallocBackend()
+{
+  void* b = MallocBackend::allocateRaw(10);
+  RG_EXPECT(b);
+  MallocBackend::deallocateRaw(b);
+
+  const BackendAllocator* ba = &BackendAdapter<MallocBackend>::instance;
+  RG_EXPECT(ba && ba == &BackendAdapter<MallocBackend>::instance);
+  RG_EXPECT(ba != &BackendAdapter<NewDeleteBackend>::instance);
+  b = ba->allocateAlignedRaw(4096, 4096);
+  RG_EXPECT(b && (size_t(b) & 4095) == 0);
+  ba->deallocateAlignedRaw(b, 4096);
+  RG_EXPECT(ba->getMaxPageShift() == NewDeleteBackend::cnMaxPageShift);
+}
+
+RG_ADD_UNITTEST2(test_MallocBackend, 1);
+
+//========================================================================================
+// MmapBackend helpers
+//________________________________________________________________________________________
+#ifdef RG_HAS_MMAP
+
+static const size_t cnHugePageSize = size_t(1) << MmapBackend::cnMaxPageShift;
+
+// MAP_HUGETLB is given up for good when not supported (EINVAL); after other failures
+// (e.g. ENOMEM: all the reserved huge pages are in use) it is skipped for the next 
+// cnHugeTlbRetryInterval huge Pages, then tried again.
+static const unsigned cnHugeTlbRetryInterval = 64;
+static std::atomic<bool> bHugeTlbSupported(true);
+static std::atomic<unsigned> nHugeTlbSkips(0);
+
+static bool shouldTryHugeTlb()
+{
+  if (!bHugeTlbSupported.load(std::memory_order_relaxed))
+    return false;
+  unsigned nSkips = nHugeTlbSkips.load(std::memory_order_relaxed);
+  if (nSkips == 0)
+    return true;
+  nHugeTlbSkips.store(nSkips - 1, std::memory_order_relaxed); // Racy, but only a count
+  return false;
+}
+
+static size_t getOsPageSize()
+{
+  static const size_t nSize = size_t(sysconf(_SC_PAGESIZE));
+  return nSize;
+}
+
+// Page sizes (see Page::calcFirstPageShift()) that are worth a mapping: powers of two,
+// from an OS page up to a huge page. Decided on the size alone, as the deallocation 
+// gets no alignment.
+static bool isMappedSize(size_t size)
+{
+  return size >= getOsPageSize() && size <= cnHugePageSize && (size & (size - 1)) == 0;
+}
+
+// Maps 'size' bytes aligned to 'alignment' by over-mapping and unmapping the excess.
+static void* mapAligned(size_t size, size_t alignment)
+{
+  size_t nExtra = alignment > getOsPageSize() ? alignment - getOsPageSize() : 0;
+  void* raw = mmap(nullptr, size + nExtra, PROT_READ | PROT_WRITE, 
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED)
+    throw std::bad_alloc();
+
+  char* begin = (char*) raw;
+  char* ret = (char*) ((size_t(begin) + alignment - 1) & ~(alignment - 1));
+  if (ret > begin)
+    munmap(begin, ret - begin);
+  if (size_t nTail = begin + size + nExtra - (ret + size))
+    munmap(ret + size, nTail);
+  return ret;
+}
+
+#endif // RG_HAS_MMAP
+
+//========================================================================================
+// Only the Page sizes are mapped (see isMappedSize()); the rest - smaller Pages, and
+// over-aligned arrays - come from NewDeleteBackend. Huge Pages try MAP_HUGETLB first,
+// then transparent huge pages.
+//________________________________________________________________________________________
+void* MmapBackend::allocateAlignedRaw(size_t size, size_t alignment)
+{
+  assert (alignment > 0 && (alignment & (alignment - 1)) == 0);
+  #ifdef RG_HAS_MMAP
+    if (!isMappedSize(size))
+      return NewDeleteBackend::allocateAlignedRaw(size, alignment);
+    bool bHuge = size == cnHugePageSize && alignment <= cnHugePageSize;
+
+    #ifdef MAP_HUGETLB
+      if (bHuge && shouldTryHugeTlb())
+      {
+        void* ret = mmap(nullptr, size, PROT_READ | PROT_WRITE, 
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ret != MAP_FAILED)
+          return ret; // Aligned to the huge page size
+        if (errno == EINVAL)
+          bHugeTlbSupported.store(false, std::memory_order_relaxed);
+        else
+          nHugeTlbSkips.store(cnHugeTlbRetryInterval, std::memory_order_relaxed);
+      }
+    #endif
+
+    void* ret = mapAligned(size, alignment);
+    #ifdef MADV_HUGEPAGE
+      if (bHuge)
+        madvise(ret, size, MADV_HUGEPAGE); // Only a hint; failure is harmless
+    #endif
+    return ret;
+  #else
+    return NewDeleteBackend::allocateAlignedRaw(size, alignment);
+  #endif
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void MmapBackend::deallocateAlignedRaw(void* b, size_t size)
 {
-  return ::operator new(size);
+  #ifdef RG_HAS_MMAP
+    if (!isMappedSize(size))
+      NewDeleteBackend::deallocateAlignedRaw(b, size);
+    else
+      munmap(b, size);
+  #else
+    NewDeleteBackend::deallocateAlignedRaw(b, size);
+  #endif
 }
 
 //========================================================================================
-// Eploratory - new()/delete() statistics
+// MmapBackend unittests
 //________________________________________________________________________________________
-void NewDeleteBackend::deallocateRaw(void* b) const
+void test_MmapBackend()
 {
-  ::operator delete(b);
+  for (size_t size : {64u, 4096u, 64*1024u, 2*1024*1024u})
+  {
+    char* b = (char*) MmapBackend::allocateAlignedRaw(size, size);
+    RG_EXPECT(b && (size_t(b) & (size - 1)) == 0);
+    b[0] = b[size - 1] = 1; // Must be writable
+    MmapBackend::deallocateAlignedRaw(b, size);
+  }
+
+  // Other sizes (e.g. over-aligned arrays) are not mapped, whatever their alignment:
+  for (size_t size : {3*4096u + 64, 64*1024u + 64})
+  {
+    char* b = (char*) MmapBackend::allocateAlignedRaw(size, 64);
+    RG_EXPECT(b && (size_t(b) & 63) == 0);
+    b[0] = b[size - 1] = 1;
+    MmapBackend::deallocateAlignedRaw(b, size);
+  }
+
+  const BackendAllocator* ba = &BackendAdapter<MmapBackend>::instance;
+  RG_EXPECT(ba->getMaxPageShift() == MmapBackend::cnMaxPageShift);
+  void* b = ba->allocateRaw(10);
+  RG_EXPECT(b);
+  ba->deallocateRaw(b);
 }
 
-const NewDeleteBackend newDeleteBackend;
+RG_ADD_UNITTEST2(test_MmapBackend, 1);
 
-const BackendAllocator* const theBackendAllocator = &newDeleteBackend;
+// An address constant: initialized statically, before any dynamic initialization.
+const BackendAllocator* const theBackendAllocator = &BackendAdapter<NewDeleteBackend>::instance;
 
 } // namespace rg_privateallocator
 
@@ -4,6 +4,11 @@
 // in form of static functions.
 // Used to wrap back-end new/delete (or malloc/free) and optionally insert instrumentation,
 // e.g. counting/high-water-mark etc.
+// A backend is a class with static functions allocateRaw(), deallocateRaw(), 
+// allocateAlignedRaw() and deallocateAlignedRaw(), and a constant cnMaxPageShift (the
+// log2 of the largest aligned block worth asking for). The allocators take it as a template
+// parameter and call it directly (inlined) for the allocations they pass through, 
+// while the (non-template) Page machinery calls it through BackendAdapter<>.
 //
 // Author: 
 //     Radoslav Getov, getov@mail.com  
@@ -16,6 +21,8 @@
 // ------------------------------------- #Includes ---------------------------------------
 
 #include <memory> // std::allocator
+#include <cstdlib> // malloc, free
+#include <new> // bad_alloc
 #include <cassert>
 
 // ------------------------------------- Definitions -------------------------------------
@@ -31,22 +38,166 @@ struct BackendAllocator
 {
   virtual void* allocateRaw(size_t size) const = 0;
   virtual void deallocateRaw(void* b) const = 0;
-};
 
-// The BackendAllcator that PrivateAllocator<> uses for *all* (not just Page) allocations and 
-// deallocations
-extern const BackendAllocator* const theBackendAllocator;
+  // 'alignment' is a power of 2; such blocks are only freed by deallocateAlignedRaw(),
+  // with the same 'size':
+  virtual void* allocateAlignedRaw(size_t size, size_t alignment) const = 0;
+  virtual void deallocateAlignedRaw(void* b, size_t size) const = 0;
 
+  // Log2 of the largest Page (i.e. aligned block) to request:
+  virtual size_t getMaxPageShift() const = 0;
+};
 
 //*****************************************************************************************
-// BackendAllocator implementation using ::operator new() and ::operator delete()
+// BackendAllocator implemented by a backend with static functions.
 //________________________________________________________________________________________
-struct NewDeleteBackend : BackendAllocator
+template <typename Backend>
+struct BackendAdapter : BackendAllocator
 {
   void* allocateRaw(size_t size) const override;
   void deallocateRaw(void* b) const override;
+  void* allocateAlignedRaw(size_t size, size_t alignment) const override;
+  void deallocateAlignedRaw(void* b, size_t size) const override;
+  size_t getMaxPageShift() const override;
+
+  static const BackendAdapter instance; // The only one needed
 };
 
+template <typename Backend>
+const BackendAdapter<Backend> BackendAdapter<Backend>::instance;
+
+template <typename Backend>
+void* BackendAdapter<Backend>::allocateRaw(size_t size) const
+{
+  return Backend::allocateRaw(size);
+}
+
+template <typename Backend>
+void BackendAdapter<Backend>::deallocateRaw(void* b) const
+{
+  Backend::deallocateRaw(b);
+}
+
+template <typename Backend>
+void* BackendAdapter<Backend>::allocateAlignedRaw(size_t size, size_t alignment) const
+{
+  return Backend::allocateAlignedRaw(size, alignment);
+}
+
+template <typename Backend>
+void BackendAdapter<Backend>::deallocateAlignedRaw(void* b, size_t size) const
+{
+  Backend::deallocateAlignedRaw(b, size);
+}
+
+template <typename Backend>
+size_t BackendAdapter<Backend>::getMaxPageShift() const
+{
+  return Backend::cnMaxPageShift;
+}
+
+
+//*****************************************************************************************
+// Backend using ::operator new() and ::operator delete(). The default one.
+//________________________________________________________________________________________
+struct NewDeleteBackend
+{
+  static void* allocateRaw(size_t size);
+  static void deallocateRaw(void* b);
+
+  // ::operator new() has no alignment (prior to C++17); uses the platform's aligned malloc
+  static void* allocateAlignedRaw(size_t size, size_t alignment);
+  static void deallocateAlignedRaw(void* b, size_t size);
+
+  // 128 KiB; larger blocks from the general-purpose heap would gain nothing
+  static const size_t cnMaxPageShift = 17;
+};
+
+inline void* NewDeleteBackend::allocateRaw(size_t size)
+{
+  return ::operator new(size);
+}
+
+inline void NewDeleteBackend::deallocateRaw(void* b)
+{
+  ::operator delete(b);
+}
+
+
+//*****************************************************************************************
+// Backend using malloc() and free()
+//________________________________________________________________________________________
+struct MallocBackend
+{
+  static void* allocateRaw(size_t size);
+  static void deallocateRaw(void* b);
+
+  // Same as NewDeleteBackend's
+  static void* allocateAlignedRaw(size_t size, size_t alignment);
+  static void deallocateAlignedRaw(void* b, size_t size);
+
+  static const size_t cnMaxPageShift = NewDeleteBackend::cnMaxPageShift;
+};
+
+inline void* MallocBackend::allocateRaw(size_t size)
+{
+  if (void* ret = malloc(size))
+    return ret;
+  throw std::bad_alloc();
+}
+
+inline void MallocBackend::deallocateRaw(void* b)
+{
+  free(b);
+}
+
+inline void* MallocBackend::allocateAlignedRaw(size_t size, size_t alignment)
+{
+  return NewDeleteBackend::allocateAlignedRaw(size, alignment);
+}
+
+inline void MallocBackend::deallocateAlignedRaw(void* b, size_t size)
+{
+  NewDeleteBackend::deallocateAlignedRaw(b, size);
+}
+
+
+//*****************************************************************************************
+// Backend mapping the Pages directly from the OS (mmap()), up to 2 MiB - a whole huge 
+// page - each, in order to cut the TLB misses of traversing large containers.
+// Pages of 2 MiB are mapped with MAP_HUGETLB while the system has free reserved huge 
+// pages (retried periodically once they run out); otherwise they are mapped normally 
+// and advised (MADV_HUGEPAGE) for transparent huge pages. Only the Page sizes - powers
+// of two from an OS page up to 2 MiB - are mapped: smaller Pages, and over-aligned 
+// arrays of other sizes, come from NewDeleteBackend::allocateAlignedRaw(); the other 
+// arrays from malloc(). Without mmap() (e.g. on Windows) it is the same as 
+// MallocBackend, except for the Page size.
+//________________________________________________________________________________________
+struct MmapBackend
+{
+  static void* allocateRaw(size_t size);
+  static void deallocateRaw(void* b);
+
+  static void* allocateAlignedRaw(size_t size, size_t alignment);
+  static void deallocateAlignedRaw(void* b, size_t size);
+
+  static const size_t cnMaxPageShift = 21; // 2 MiB, the usual huge page
+};
+
+inline void* MmapBackend::allocateRaw(size_t size)
+{
+  return MallocBackend::allocateRaw(size);
+}
+
+inline void MmapBackend::deallocateRaw(void* b)
+{
+  MallocBackend::deallocateRaw(b);
+}
+
+// The BackendAllocator of NewDeleteBackend, used by default, and for the bookkeeping
+// structures of all allocators.
+extern const BackendAllocator* const theBackendAllocator;
+
 // -------------------------------- End Of File ------------------------------------------
 
 } // namespace rg_privateallocator
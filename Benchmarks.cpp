@@ -14,6 +14,8 @@
 // No own header file
 
 #include "PrivateAllocator.h"
+#include "ConcurrentPrivateAllocator.h"
+#include "PrivatePoolResource.h"
 #include "Unittest.h"
 
 #include <string>
@@ -66,6 +68,37 @@ typedef std::unordered_multiset<BenchmarkValue,
                                 PA_Type> PA_hash;
 typedef std::unordered_multiset<BenchmarkValue> hash;
 
+// Pages mapped by mmap(), possibly on huge pages
+typedef std::list<BenchmarkValue, PrivateAllocator<BenchmarkValue, MmapBackend>> PA_mmap_list;
+
+// Nodes within cache lines (24 bytes padded to 32), in colored Pages
+struct CacheLineTraits : DefaultAllocatorTraits
+{
+  static const bool cbCacheLineBlocks = true;
+  static const size_t cnPageColors = 8;
+};
+typedef std::list<BenchmarkValue, 
+                  PrivateAllocator<BenchmarkValue, NewDeleteBackend, CacheLineTraits>> 
+        PA_cacheline_list;
+
+// First Pages for the typical size of the earlier lists
+struct AdaptiveTraits : DefaultAllocatorTraits
+{
+  static const bool cbAdaptiveFirstPage = true;
+};
+typedef std::list<BenchmarkValue, 
+                  PrivateAllocator<BenchmarkValue, NewDeleteBackend, AdaptiveTraits>> 
+        PA_adaptive_list;
+
+// Free blocks tracked by per-Page bitmaps, handed out in address order
+struct BitmapTraits : DefaultAllocatorTraits
+{
+  static const bool cbBitmapPages = true;
+};
+typedef std::list<BenchmarkValue, 
+                  PrivateAllocator<BenchmarkValue, NewDeleteBackend, BitmapTraits>> 
+        PA_bitmap_list;
+
 // The 'pure' (data only) memory for each benchmark - per thread, in bytes. 
 const size_t cnBenchmarkMemory = sizeof(void*) >= 8 // i.e. 64bit platform
                                    ? 100*1000*1000 
@@ -74,6 +107,9 @@ const size_t cnBenchmarkMemory = sizeof(void*) >= 8 // i.e. 64bit platform
 // The peak sum of the sizes of containers during a benchmark
 const size_t cnBenchmarkCapacity = cnBenchmarkMemory / sizeof(BenchmarkValue);
 
+// The size of each of the containers in the 'small' benchmarks
+const size_t cnSmallContainerSize = 1000;
+
 // The minimal duration of each single benchmark, in seconds.
 double dBenchmarkDuration = 5.0; 
 
@@ -137,6 +173,11 @@ static void fillContainer(std::forward_list<V, A>& container, size_t size)
 
 
 //========================================================================================
+// The ConcurrentPrivateAllocator and containers, for the 'shared' benchmarks
+typedef ConcurrentPrivateAllocator<BenchmarkValue> CPA_Type;
+typedef std::list<BenchmarkValue, CPA_Type> CPA_list;
+typedef std::multiset<BenchmarkValue, std::less<BenchmarkValue>, CPA_Type> CPA_multiset;
+
 // Returns current wall-clock time relative to some arbitrary initial moment (~1st call).
 //________________________________________________________________________________________
 static double getWallclockTime()
@@ -151,18 +192,22 @@ static double getWallclockTime()
 }
 
 //========================================================================================
-// Creates a local Container of size 'preFillSize' and then measures the average 
-// call rate to 'measuredFunction(container)' in calls per second.
+// Creates a local Container of size 'preFillSize', passes it to 'prepareFunction' (if
+// any), and then measures the average call rate to 'measuredFunction(container)' in 
+// calls per second.
 // Writes the result to '*outputResultCallsPerSecond'.
 //________________________________________________________________________________________
 template <typename Container>
 void measureContainerFunctionCallRate(void (*measuredFunction)(Container&), 
                                       size_t preFillSize, 
-                                      double *outputResultCallsPerSecond)
+                                      double *outputResultCallsPerSecond,
+                                      void (*prepareFunction)(Container&) = nullptr)
 {
   // Pre-fill a local container:
   Container localContainer;
   fillContainer(localContainer, preFillSize);
+  if (prepareFunction)
+    prepareFunction(localContainer);
 
   // Regardless of overal duration perform at least that many loops:
   const int cnMinLoops 
@@ -204,6 +249,52 @@ static void benchmarkFill(double* outputResultCallsPerSecond)
                                               outputResultCallsPerSecond);
 }
 
+//========================================================================================
+// Same as benchmarkFill, with the Pages for all list nodes reserved up-front.
+//________________________________________________________________________________________
+static void benchmarkFillReserved(double* outputResultCallsPerSecond)
+{
+  auto testFunction = [](PA_list&)->void
+  {
+    PA_list local;
+    local.get_allocator().reserve(cnBenchmarkCapacity, 
+                                  sizeof(BenchmarkValue) + 2 * sizeof(void*));
+    fillContainer(local, cnBenchmarkCapacity);
+  };
+  measureContainerFunctionCallRate<PA_list>(testFunction, 0, outputResultCallsPerSecond);
+}
+
+//========================================================================================
+// Same as benchmarkFill, with the container destroyed by winkOut(): all Pages released
+// at once, no node returned.
+//________________________________________________________________________________________
+template <typename Container>
+static void benchmarkFillWinkOut(double* outputResultCallsPerSecond)
+{
+  auto testFunction = [](Container&)->void
+  {
+    Container local;
+    fillContainer(local, cnBenchmarkCapacity);
+    winkOut(local);
+  };
+  measureContainerFunctionCallRate<Container>(testFunction, 0, outputResultCallsPerSecond);
+}
+
+//========================================================================================
+// Same as benchmarkFill, in many small containers, all alive at once.
+//________________________________________________________________________________________
+template <typename Container>
+static void benchmarkFillSmall(double* outputResultCallsPerSecond)
+{
+  auto testFunction = [](Container&)->void
+  {
+    std::vector<Container> locals(cnBenchmarkCapacity / cnSmallContainerSize);
+    for (Container& local : locals)
+      fillContainer(local, cnSmallContainerSize);
+  };
+  measureContainerFunctionCallRate<Container>(testFunction, 0, outputResultCallsPerSecond);
+}
+
 //========================================================================================
 //________________________________________________________________________________________
 static void doAllFillBenchmarks()
@@ -222,10 +313,28 @@ static void doAllFillBenchmarks()
   for (int tc : {1, 4})
     benchmarkSideBySide(benchmarkFill<PA_list>, benchmarkFill<list>, tc);
 
+  std::cout << "list<> (winkOut()):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkFillWinkOut<PA_list>, benchmarkFill<list>, tc);
+
+  std::cout << "small list<>s:\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkFillSmall<PA_list>, benchmarkFillSmall<list>, tc);
+
+  std::cout << "small list<>s (AdaptiveTraits):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkFillSmall<PA_adaptive_list>, 
+                        benchmarkFillSmall<list>, 
+                        tc);
+
   std::cout << "multiset<>:\n";
   for (int tc : {1, 4})
     benchmarkSideBySide(benchmarkFill<PA_multiset>, benchmarkFill<multiset>, tc);
 
+  std::cout << "multiset<> (winkOut()):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkFillWinkOut<PA_multiset>, benchmarkFill<multiset>, tc);
+
   std::cout << "hash<>:\n";
   for (int tc : {1, 4})
     benchmarkSideBySide(benchmarkFill<PA_hash>, benchmarkFill<hash>, tc);
@@ -354,24 +463,105 @@ static void doAllInsertDeleteBenchmarks()
 //========================================================================================
 // Read/modify/write all items in a Container.
 //________________________________________________________________________________________
+template <typename Container>
+static void readModifyWrite(Container& container)
+{
+  // Read/write each item:
+  for (auto& i : container)
+    ++i; // Read/modify/write
+  // Additional sequential full read, just for fun:
+  container.front() += std::accumulate(container.begin(), 
+                                       container.end(), 
+                                       BenchmarkValue());    
+}
+
 template <typename Container>
 static void benchmarkReadWrite(double* outputResultCallsPerSecond)
 {
-  auto readModifyWrite = [](Container& container) -> void
-  {
-    // Read/write each item:
-    for (auto& i : container)
-      ++i; // Read/modify/write
-    // Additional sequential full read, just for fun:
-    container.front() += std::accumulate(container.begin(), 
-                                         container.end(), 
-                                         BenchmarkValue());    
-  };
-  measureContainerFunctionCallRate<Container>(readModifyWrite, 
+  measureContainerFunctionCallRate<Container>(readModifyWrite<Container>, 
                                               cnBenchmarkCapacity, 
                                               outputResultCallsPerSecond);
 }
 
+//========================================================================================
+// Relinks the nodes of a list in a pseudo-random order.
+//________________________________________________________________________________________
+template <typename Container>
+static void shuffleList(Container& container)
+{
+  container.sort([](BenchmarkValue a, BenchmarkValue b) 
+  { 
+    return uint64_t(a) * 0x9E3779B97F4A7C15ull < uint64_t(b) * 0x9E3779B97F4A7C15ull;
+  });
+}
+
+//========================================================================================
+// Same as benchmarkReadWrite, with the list nodes shuffled first, so that each item 
+// visited is a cache miss, rather than part of a prefetched stream; whether a node 
+// straddles two cache lines then shows up.
+//________________________________________________________________________________________
+template <typename Container>
+static void benchmarkShuffledReadWrite(double* outputResultCallsPerSecond)
+{
+  measureContainerFunctionCallRate<Container>(readModifyWrite<Container>, 
+                                              cnBenchmarkCapacity, 
+                                              outputResultCallsPerSecond,
+                                              shuffleList<Container>);
+}
+
+//========================================================================================
+// A list rebuilt after churn (e.g. long insert/erase in random places) shuffled its 
+// nodes: clear() frees them in that order, so the rebuilt list gets them in that order 
+// too - unless the free blocks are sorted by address in between.
+//________________________________________________________________________________________
+template <typename Container>
+static void rebuildAfterChurn(Container& container)
+{
+  shuffleList(container);
+  size_t nSize = container.size();
+  container.clear();
+  fillContainer(container, nSize);
+}
+
+template <typename Container>
+static void rebuildAfterChurnSorted(Container& container)
+{
+  shuffleList(container);
+  size_t nSize = container.size();
+  container.clear();
+  container.get_allocator().sortFreeBlocks();
+  fillContainer(container, nSize);
+}
+
+// Or compacted after churn, in traversal order: for std, by a copy.
+template <typename Container>
+static void compactAfterChurn(Container& container)
+{
+  shuffleList(container);
+  Container compacted(container.begin(), container.end());
+  container.swap(compacted);
+}
+
+// Specialization using compact().
+template <>
+void compactAfterChurn<PA_list>(PA_list& container)
+{
+  shuffleList(container);
+  compact(container);
+}
+
+//========================================================================================
+// Same as benchmarkReadWrite, after 'rebuild' of the list.
+//________________________________________________________________________________________
+template <typename Container, void (*rebuild)(Container&)>
+static void benchmarkChurnedReadWrite(double* outputResultCallsPerSecond)
+{
+  measureContainerFunctionCallRate<Container>(readModifyWrite<Container>, 
+                                              cnBenchmarkCapacity, 
+                                              outputResultCallsPerSecond,
+                                              rebuild);
+}
+
 //========================================================================================
 //________________________________________________________________________________________
 static void doAllReadWriteBenchmarks()
@@ -392,9 +582,184 @@ static void doAllReadWriteBenchmarks()
   for (int tc : {1, 4})
     benchmarkSideBySide(benchmarkReadWrite<PA_list>, benchmarkReadWrite<list>, tc);
 
+  std::cout << "list<> (MmapBackend):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkReadWrite<PA_mmap_list>, benchmarkReadWrite<list>, tc);
+
+  std::cout << "list<> (shuffled nodes):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkShuffledReadWrite<PA_list>, 
+                        benchmarkShuffledReadWrite<list>, 
+                        tc);
+
+  std::cout << "list<> (shuffled nodes, CacheLineTraits):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkShuffledReadWrite<PA_cacheline_list>, 
+                        benchmarkShuffledReadWrite<list>, 
+                        tc);
+
+  std::cout << "list<> (rebuilt after churn):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkChurnedReadWrite<PA_list, rebuildAfterChurn<PA_list>>, 
+                        benchmarkChurnedReadWrite<list, rebuildAfterChurn<list>>, 
+                        tc);
+
+  std::cout << "list<> (rebuilt after churn, with sortFreeBlocks()):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(
+      benchmarkChurnedReadWrite<PA_list, rebuildAfterChurnSorted<PA_list>>, 
+      benchmarkChurnedReadWrite<list, rebuildAfterChurn<list>>, 
+      tc);
+
+  std::cout << "list<> (rebuilt after churn, BitmapTraits):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(
+      benchmarkChurnedReadWrite<PA_bitmap_list, rebuildAfterChurn<PA_bitmap_list>>, 
+      benchmarkChurnedReadWrite<list, rebuildAfterChurn<list>>, 
+      tc);
+
+  std::cout << "list<> (compacted after churn):\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkChurnedReadWrite<PA_list, compactAfterChurn<PA_list>>, 
+                        benchmarkChurnedReadWrite<list, compactAfterChurn<list>>, 
+                        tc);
+
   std::cout << '\n';
 }
 
+//========================================================================================
+// The allocators shared by all threads in the 'shared' benchmarks.
+//________________________________________________________________________________________
+template <bool bThreadCaching>
+static CPA_Type& getSharedAllocator()
+{
+  static CPA_Type sharedAllocator(bThreadCaching);
+  return sharedAllocator;
+}
+
+//========================================================================================
+// Replaces the shared allocators, so that the Pages of the benchmarks run so far get 
+// released.
+//________________________________________________________________________________________
+static void resetSharedAllocators()
+{
+  getSharedAllocator<false>() = CPA_Type(false);
+  getSharedAllocator<true>() = CPA_Type(true);
+}
+
+//========================================================================================
+// Benchmarks 'container fill', where the containers of all threads allocate from the
+// same allocator clique (copies of a single static ConcurrentPrivateAllocator<>),
+// with or without per-thread caches.
+//________________________________________________________________________________________
+template <typename Container, bool bThreadCaching>
+static void benchmarkSharedFill(double* outputResultCallsPerSecond)
+{
+  auto testFunction = [](Container&)->void
+  {
+    Container local(getSharedAllocator<bThreadCaching>());
+    fillContainer(local, cnBenchmarkCapacity);
+  };
+  measureContainerFunctionCallRate<Container>(testFunction, 
+                                              0, // Don't need pre-filled container.
+                                              outputResultCallsPerSecond);
+}
+
+//========================================================================================
+// As benchmarkSideBySide(), but without keeping the shared memory for the next one.
+//________________________________________________________________________________________
+static void benchmarkSharedSideBySide(BenchmarkingFunction function_PA, 
+                                      BenchmarkingFunction function_STD, 
+                                      int                  nThreadCount)
+{
+  benchmarkSideBySide(function_PA, function_STD, nThreadCount);
+  resetSharedAllocators();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+static void doAllSharedBenchmarks()
+{
+  std::cout << "********* Side by side benchmarks - SHARED (concurrent) FILL: *********\n";
+
+  std::cout << "list<>:\n";
+  for (int tc : {1, 4})
+    benchmarkSharedSideBySide(benchmarkSharedFill<CPA_list, false>, 
+                              benchmarkFill<list>, 
+                              tc);
+
+  std::cout << "multiset<>:\n";
+  for (int tc : {1, 4})
+    benchmarkSharedSideBySide(benchmarkSharedFill<CPA_multiset, false>, 
+                              benchmarkFill<multiset>, 
+                              tc);
+
+  std::cout << "list<>, thread-cached:\n";
+  for (int tc : {1, 4})
+    benchmarkSharedSideBySide(benchmarkSharedFill<CPA_list, true>, 
+                              benchmarkFill<list>, 
+                              tc);
+
+  std::cout << "multiset<>, thread-cached:\n";
+  for (int tc : {1, 4})
+    benchmarkSharedSideBySide(benchmarkSharedFill<CPA_multiset, true>, 
+                              benchmarkFill<multiset>, 
+                              tc);
+
+  std::cout << '\n';
+}
+
+#if RG_PRIVATEPOOLRESOURCE
+
+//========================================================================================
+// The std::pmr containers for the 'pmr' benchmarks
+typedef std::pmr::list<BenchmarkValue> PMR_list;
+typedef std::pmr::multiset<BenchmarkValue> PMR_multiset;
+
+//========================================================================================
+// Benchmarks 'container fill', with a new Resource for each container: 
+// PrivatePoolResource vs. std::pmr::unsynchronized_pool_resource (as 'std').
+//________________________________________________________________________________________
+template <typename Container, typename Resource>
+static void benchmarkPmrFill(double* outputResultCallsPerSecond)
+{
+  auto testFunction = [](Container&)->void
+  {
+    Resource resource;
+    Container local(&resource);
+    fillContainer(local, cnBenchmarkCapacity);
+  };
+  measureContainerFunctionCallRate<Container>(testFunction, 
+                                              0, // Don't need pre-filled container.
+                                              outputResultCallsPerSecond);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+static void doAllPmrBenchmarks()
+{
+  typedef std::pmr::unsynchronized_pool_resource StdResource;
+
+  std::cout << "************** Side by side benchmarks - PMR FILL: **************\n"
+               "(std = std::pmr::unsynchronized_pool_resource)\n";
+
+  std::cout << "pmr::list<>:\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkPmrFill<PMR_list, PrivatePoolResource>, 
+                        benchmarkPmrFill<PMR_list, StdResource>, 
+                        tc);
+
+  std::cout << "pmr::multiset<>:\n";
+  for (int tc : {1, 4})
+    benchmarkSideBySide(benchmarkPmrFill<PMR_multiset, PrivatePoolResource>, 
+                        benchmarkPmrFill<PMR_multiset, StdResource>, 
+                        tc);
+
+  std::cout << '\n';
+}
+
+#endif // RG_PRIVATEPOOLRESOURCE
+
 //========================================================================================
 //________________________________________________________________________________________
 static void doAllSideBySideBenchmarks()
@@ -403,6 +768,10 @@ static void doAllSideBySideBenchmarks()
   doAllCopyBenchmarks(); 
   doAllInsertDeleteBenchmarks();
   doAllReadWriteBenchmarks();
+  doAllSharedBenchmarks();
+  #if RG_PRIVATEPOOLRESOURCE
+    doAllPmrBenchmarks();
+  #endif
 }
 
 
@@ -435,8 +804,18 @@ static BenchmarkingFunction selectTestFunction(std::string container_type,
     {{"forward_list", "fill", true}, benchmarkFill<PA_forward_list>},
     {{"list", "fill", false}, benchmarkFill<list>},
     {{"list", "fill", true}, benchmarkFill<PA_list>},
+    {{"list", "fillReserved", false}, benchmarkFill<list>},
+    {{"list", "fillReserved", true}, benchmarkFillReserved},
+    {{"list", "fillWinkOut", false}, benchmarkFill<list>},
+    {{"list", "fillWinkOut", true}, benchmarkFillWinkOut<PA_list>},
+    {{"list", "fillSmall", false}, benchmarkFillSmall<list>},
+    {{"list", "fillSmall", true}, benchmarkFillSmall<PA_list>},
+    {{"list", "fillSmallAdaptive", false}, benchmarkFillSmall<list>},
+    {{"list", "fillSmallAdaptive", true}, benchmarkFillSmall<PA_adaptive_list>},
     {{"multiset", "fill", false}, benchmarkFill<multiset>},
     {{"multiset", "fill", true}, benchmarkFill<PA_multiset>},
+    {{"multiset", "fillWinkOut", false}, benchmarkFill<multiset>},
+    {{"multiset", "fillWinkOut", true}, benchmarkFillWinkOut<PA_multiset>},
     {{"hash", "fill", false}, benchmarkFill<hash>},
     {{"hash", "fill", true}, benchmarkFill<PA_hash>},
 
@@ -464,6 +843,47 @@ static BenchmarkingFunction selectTestFunction(std::string container_type,
     {{"forward_list", "readWrite", true}, benchmarkReadWrite<PA_forward_list>},
     {{"list", "readWrite", false}, benchmarkReadWrite<list>},
     {{"list", "readWrite", true}, benchmarkReadWrite<PA_list>},
+    {{"list", "readWriteMmap", false}, benchmarkReadWrite<list>},
+    {{"list", "readWriteMmap", true}, benchmarkReadWrite<PA_mmap_list>},
+    {{"list", "readWriteShuffled", false}, benchmarkShuffledReadWrite<list>},
+    {{"list", "readWriteShuffled", true}, benchmarkShuffledReadWrite<PA_list>},
+    {{"list", "readWriteCacheLine", false}, benchmarkShuffledReadWrite<list>},
+    {{"list", "readWriteCacheLine", true}, 
+      benchmarkShuffledReadWrite<PA_cacheline_list>},
+    {{"list", "readWriteChurned", false}, 
+      benchmarkChurnedReadWrite<list, rebuildAfterChurn<list>>},
+    {{"list", "readWriteChurned", true}, 
+      benchmarkChurnedReadWrite<PA_list, rebuildAfterChurn<PA_list>>},
+    {{"list", "readWriteChurnedSorted", false}, 
+      benchmarkChurnedReadWrite<list, rebuildAfterChurn<list>>},
+    {{"list", "readWriteChurnedSorted", true}, 
+      benchmarkChurnedReadWrite<PA_list, rebuildAfterChurnSorted<PA_list>>},
+    {{"list", "readWriteChurnedBitmap", false}, 
+      benchmarkChurnedReadWrite<list, rebuildAfterChurn<list>>},
+    {{"list", "readWriteChurnedBitmap", true}, 
+      benchmarkChurnedReadWrite<PA_bitmap_list, rebuildAfterChurn<PA_bitmap_list>>},
+    {{"list", "readWriteCompacted", false}, 
+      benchmarkChurnedReadWrite<list, compactAfterChurn<list>>},
+    {{"list", "readWriteCompacted", true}, 
+      benchmarkChurnedReadWrite<PA_list, compactAfterChurn<PA_list>>},
+
+    {{"list", "shared", false}, benchmarkFill<list>},
+    {{"list", "shared", true}, benchmarkSharedFill<CPA_list, false>},
+    {{"multiset", "shared", false}, benchmarkFill<multiset>},
+    {{"multiset", "shared", true}, benchmarkSharedFill<CPA_multiset, false>},
+    {{"list", "sharedCached", false}, benchmarkFill<list>},
+    {{"list", "sharedCached", true}, benchmarkSharedFill<CPA_list, true>},
+    {{"multiset", "sharedCached", false}, benchmarkFill<multiset>},
+    {{"multiset", "sharedCached", true}, benchmarkSharedFill<CPA_multiset, true>},
+
+    #if RG_PRIVATEPOOLRESOURCE
+      {{"list", "pmr", false}, 
+        benchmarkPmrFill<PMR_list, std::pmr::unsynchronized_pool_resource>},
+      {{"list", "pmr", true}, benchmarkPmrFill<PMR_list, PrivatePoolResource>},
+      {{"multiset", "pmr", false}, 
+        benchmarkPmrFill<PMR_multiset, std::pmr::unsynchronized_pool_resource>},
+      {{"multiset", "pmr", true}, benchmarkPmrFill<PMR_multiset, PrivatePoolResource>},
+    #endif
   };
 
   TestId id = { container_type, algorithm_type, usePrivateAllocator};
@@ -556,7 +976,30 @@ static void parseArgsRunTest(int argc, const char* argv[])
     "     Benchmark particular combination of container and test:\n"
     "     <container>: vector|forward_list|list|multiset|hash\n"
     "                    (hash is for 'unordered_multiset')\n"
-    "     <algorithm>:  fill|copy|insertDelete|readWrite\n"
+    "     <algorithm>:  fill|fillReserved|fillWinkOut|fillSmall|fillSmallAdaptive|\n"
+    "                   copy|insertDelete|readWrite|readWriteMmap|readWriteShuffled|\n"
+    "                   readWriteCacheLine|readWriteChurned|readWriteChurnedSorted|\n"
+    "                   readWriteChurnedBitmap|readWriteCompacted|shared|\n"
+    "                   sharedCached|pmr\n"
+    "                    (fillReserved is 'fill' after reserve() of all nodes)\n"
+    "                    (fillWinkOut is 'fill' with winkOut() of the container)\n"
+    "                    (fillSmall is 'fill' of many 1000-item lists at once;\n"
+    "                     fillSmallAdaptive - same, with AdaptiveTraits)\n"
+    "                    (readWriteMmap is 'readWrite' with Pages from mmap())\n"
+    "                    (readWriteShuffled is 'readWrite' of a list with its nodes\n"
+    "                     relinked in random order; readWriteCacheLine - same, with\n"
+    "                     CacheLineTraits: nodes within cache lines, colored Pages)\n"
+    "                    (readWriteChurned is 'readWrite' of a list rebuilt after its\n"
+    "                     nodes got shuffled; readWriteChurnedSorted - same, with\n"
+    "                     sortFreeBlocks() before the rebuild; readWriteChurnedBitmap\n"
+    "                     - with BitmapTraits, unsorted; readWriteCompacted - with\n"
+    "                     compact() of the shuffled list instead)\n"
+    "                    (shared is 'fill' by all threads through copies of one\n"
+    "                     ConcurrentPrivateAllocator<>; sharedCached - same,\n"
+    "                     with per-thread caches)\n"
+    "                    (pmr is 'fill' of std::pmr containers, each with its own\n"
+    "                     PrivatePoolResource, or unsynchronized_pool_resource for\n"
+    "                     std; C++17 builds only)\n"
     "     std|private: use standard or 'private' allocator, respectively\n"
     "     wait: wait for a keystroke before exit (to check memory usage).\n"
     "     NOTE: Not all combinations are valid.\n"
@@ -602,6 +1045,10 @@ static void parseArgsRunTest(int argc, const char* argv[])
       { "copy", rg_privateallocator::doAllCopyBenchmarks},
       { "insertDelete", rg_privateallocator::doAllInsertDeleteBenchmarks},
       { "readWrite", rg_privateallocator::doAllReadWriteBenchmarks},
+      { "shared", rg_privateallocator::doAllSharedBenchmarks},
+      #if RG_PRIVATEPOOLRESOURCE
+        { "pmr", rg_privateallocator::doAllPmrBenchmarks},
+      #endif
     };
 
     if (multiTests.count(s))
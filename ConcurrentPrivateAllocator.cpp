@@ -0,0 +1,621 @@
+// ConcurrentPrivateAllocator.cpp
+//
+// Implementation of the non-template classes, and unittests.
+//
+// Author:
+//    Radoslav Getov, getov@mail.com
+
+// ------------------------ #Includes ---------------------------------------
+
+#include "ConcurrentPrivateAllocator.h"
+
+#include "Unittest.h"
+
+#include <new> // placement new
+#include <vector>
+#include <list>
+#include <forward_list>
+#include <set>
+#include <thread>
+#include <algorithm>
+
+// --------------------------- Definitions -------------------------------------
+
+namespace rg_privateallocator
+{
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////// ConcurrentPageChain //////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//========================================================================================
+// Returns the last block of a (nullptr-terminated) list.
+//________________________________________________________________________________________
+static FreeBlock* findLastBlock(FreeBlock* b)
+{
+  while (FreeBlock* next = BlockLink::load(b))
+    b = next;
+  return b;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+ConcurrentPageChain::ConcurrentPageChain()
+  : freeBlocks_(0)
+{
+  for (auto& d : apDepot_)
+    d.store(nullptr, std::memory_order_relaxed);
+}
+
+//========================================================================================
+// The free blocks ran out: use a locked block, or a batch from the depot, if any; 
+// otherwise add a Page, keep its first block, fill the empty depot slots with batches,
+// and push the rest. Another thread may have done the same meanwhile; then, take one 
+// of its blocks.
+//________________________________________________________________________________________
+void* ConcurrentPageChain::takeBlockFromNewPage()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (FreeBlock* b = popBlock()) // Pushed meanwhile
+    return b;
+
+  if (FreeBlock* b = pLockedBlocks_)
+  {
+    pLockedBlocks_ = BlockLink::load(b);
+    return b;
+  }
+
+  if (FreeBlock* batch = popFromDepot())
+  {
+    if (FreeBlock* rest = BlockLink::load(batch))
+      pushBlocksLocked(rest, findLastBlock(rest));
+    return batch;
+  }
+
+  nPageShift_ = nPageShift_
+                  ? Page::calcNextPageShift(nPageShift_, pBackend_->getMaxPageShift())
+                  : Page::calcFirstPageShift(nBlockSize_);
+  pPage_ = Page::addNewPage(nBlockSize_, nPageShift_, pPage_, pBackend_);
+  // Set before any block of the Page is handed out - so any thread returning one sees
+  // it, even with relaxed loads (it got the block through the mutex, or from the user):
+  if (!TaggedBlockPtr::canPack(pPage_, size_t(1) << nPageShift_))
+    bLocked_.store(true, std::memory_order_relaxed);
+
+  void* ret = pPage_->takeBlock();
+  for (bool bDepotFull = false; /**/; /**/)
+  {
+    size_t nCount = pPage_->countUntouchedBlocks();
+    if (nCount == 0)
+      return ret;
+    if (nCount >= cnMagazineSize && !bDepotFull)
+      nCount = cnMagazineSize;
+
+    FreeBlock *first = nullptr,
+              *last = nullptr;
+    for (size_t j = 0; j < nCount; ++j)
+    {
+      auto b = (FreeBlock*) pPage_->takeBlock();
+      if (last)
+        BlockLink::store(last, b);
+      else
+        first = b;
+      last = b;
+    }
+    BlockLink::store(last, nullptr);
+
+    if (nCount != cnMagazineSize || !pushToDepot(first))
+    {
+      bDepotFull = true;
+      pushBlocksLocked(first, last);
+    }
+  }
+}
+
+//========================================================================================
+// Once locked, to the locked list; the blocks still in the stack are popped as usual.
+//________________________________________________________________________________________
+void ConcurrentPageChain::pushBlocksLocked(FreeBlock* first, FreeBlock* last)
+{
+  if (!bLocked_.load(std::memory_order_relaxed))
+    return pushBlocks(first, last);
+  BlockLink::store(last, pLockedBlocks_);
+  pLockedBlocks_ = first;
+}
+
+//========================================================================================
+// Takes a whole batch from the depot if there is one; otherwise, gathers the batch 
+// block by block.
+//________________________________________________________________________________________
+FreeBlock* ConcurrentPageChain::takeBatch()
+{
+  if (FreeBlock* batch = popFromDepot())
+    return batch;
+
+  FreeBlock* first = nullptr;
+  for (size_t j = 0; j < cnMagazineSize; ++j)
+  {
+    auto b = (FreeBlock*) takeBlock();
+    BlockLink::store(b, first);
+    first = b;
+  }
+  return first;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ConcurrentPageChain::returnBatch(FreeBlock* first)
+{
+  if (!pushToDepot(first))
+    returnBlocks(first);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ConcurrentPageChain::returnBlocks(FreeBlock* first)
+{
+  if (first)
+    pushBlocks(first, findLastBlock(first));
+}
+
+//========================================================================================
+// Taking a slot's batch is a plain exchange, so there is no ABA problem.
+//________________________________________________________________________________________
+bool ConcurrentPageChain::pushToDepot(FreeBlock* batch)
+{
+  for (auto& d : apDepot_)
+  {
+    FreeBlock* empty = nullptr;
+    if (d.load(std::memory_order_relaxed) == nullptr &&
+        d.compare_exchange_strong(empty, batch, std::memory_order_release))
+      return true;
+  }
+  return false;
+}
+
+FreeBlock* ConcurrentPageChain::popFromDepot()
+{
+  for (auto& d : apDepot_)
+    if (d.load(std::memory_order_relaxed))
+      if (FreeBlock* batch = d.exchange(nullptr, std::memory_order_acquire))
+        return batch;
+  return nullptr;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ConcurrentPageChain::deleteAllPages()
+{
+  Page::deleteAllPages(pPage_, pBackend_);
+  pPage_ = nullptr;
+  nPageShift_ = 0;
+  freeBlocks_.store(0);
+  for (auto& d : apDepot_)
+    d.store(nullptr);
+  pLockedBlocks_ = nullptr;
+  bLocked_.store(false);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+size_t ConcurrentPageChain::countFreeBlocks()
+{
+  size_t nRet = 0;
+  for (auto b = TaggedBlockPtr::getPtr(freeBlocks_.load()); b; b = BlockLink::load(b))
+    ++nRet;
+  for (auto& d : apDepot_)
+    nRet += d.load() ? cnMagazineSize : 0;
+  for (auto b = pLockedBlocks_; b; b = BlockLink::load(b))
+    ++nRet;
+  return nRet;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ConcurrentPageChain::setLocked()
+{
+  bLocked_.store(true);
+}
+
+//========================================================================================
+// ConcurrentPageChain unittests
+//________________________________________________________________________________________
+void test_ConcurrentPageChain()
+{
+  int x = 0;
+  uint64_t tagged = TaggedBlockPtr::pack((FreeBlock*) &x, 12345);
+  RG_EXPECT(TaggedBlockPtr::getPtr(tagged) == (FreeBlock*) &x);
+  RG_EXPECT(TaggedBlockPtr::getTag(tagged) == 12345);
+  RG_EXPECT(TaggedBlockPtr::canPack(&x, sizeof x));
+  RG_EXPECT(!TaggedBlockPtr::canPack((void*) uintptr_t(TaggedBlockPtr::cnPtrMask), 2) ||
+            sizeof(void*) < 8);
+
+  // Also locked, as if its Pages could not be packed (then the blocks are returned 
+  // through the mutex):
+  for (bool bLocked : {false, true})
+  {
+    ConcurrentPageChain chain;
+    chain.nBlockSize_ = cnMinAlign;
+    if (bLocked)
+      chain.setLocked();
+    void* b1 = chain.takeBlock();
+    size_t nFree = chain.countFreeBlocks();
+    RG_EXPECT(b1 && nFree > 0);
+    void* b2 = chain.takeBlock();
+    RG_EXPECT(b2 && b2 != b1 && chain.countFreeBlocks() == nFree - 1);
+    chain.returnBlock(b1);
+    RG_EXPECT(chain.takeBlock() == b1);
+
+    // Several threads, taking and returning blocks of the same chain. Each thread marks
+    // its blocks, and checks that no other thread has touched them:
+    const int cnThreads = 4, cnBlocks = 10000, cnRounds = 20;
+    int nCorrupted = 0;
+    std::mutex corruptedMutex;
+    auto work = [&](size_t threadId)
+    {
+      std::vector<void*> blocks(cnBlocks);
+      int nBad = 0;
+      for (int r = 0; r < cnRounds; ++r)
+      {
+        for (auto& b : blocks)
+        {
+          b = chain.takeBlock();
+          *(size_t*) b = threadId;
+        }
+        for (auto b : blocks)
+          nBad += *(size_t*) b != threadId;
+        for (auto b : blocks)
+          chain.returnBlock(b);
+      }
+      std::lock_guard<std::mutex> lock(corruptedMutex);
+      nCorrupted += nBad;
+    };
+    std::vector<std::thread> threads;
+    for (int j = 0; j < cnThreads; ++j)
+      threads.emplace_back(work, j + 1);
+    for (auto& t : threads)
+      t.join();
+    RG_EXPECT(nCorrupted == 0);
+
+    // All blocks are back, and distinct:
+    std::vector<void*> all;
+    while (chain.countFreeBlocks())
+      all.push_back(chain.takeBlock());
+    std::sort(all.begin(), all.end());
+    RG_EXPECT(all.size() >= cnBlocks); // Threads may not have overlapped
+    RG_EXPECT(std::adjacent_find(all.begin(), all.end()) == all.end());
+
+    chain.deleteAllPages();
+  }
+}
+
+RG_ADD_UNITTEST2(test_ConcurrentPageChain, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// ThreadCache //////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//========================================================================================
+//________________________________________________________________________________________
+ThreadCache::~ThreadCache()
+{
+  flush();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ThreadCache::flush()
+{
+  for (auto& s : aSlots_)
+    if (s.pPool_)
+      flushSlot(s);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ThreadCache::claimSlot(Slot& s, ConcurrentPagePool* pool, ConcurrentPageChain* chain)
+{
+  if (s.pPool_)
+    flushSlot(s);
+  pool->addHolder();
+  s.pPool_ = pool;
+  s.pChain_ = chain;
+}
+
+//========================================================================================
+// Returns the cached blocks, unless the Pages have already been deleted; then frees 
+// the slot.
+//________________________________________________________________________________________
+void ThreadCache::flushSlot(Slot& s)
+{
+  if (s.pPool_->tryAddRef())
+  {
+    s.pChain_->returnBlocks(s.loaded_.pFirst_);
+    s.pChain_->returnBlocks(s.previous_.pFirst_);
+    s.pPool_->release();
+  }
+  s.pPool_->releaseHolder();
+  s = Slot();
+}
+
+//========================================================================================
+// The loaded magazine is empty: swap in the previous one if full, or get a batch.
+//________________________________________________________________________________________
+void ThreadCache::refill(Slot& s)
+{
+  if (s.previous_.nCount_)
+    std::swap(s.loaded_, s.previous_);
+  else
+  {
+    s.loaded_.pFirst_ = s.pChain_->takeBatch();
+    s.loaded_.nCount_ = cnMagazineSize;
+  }
+}
+
+//========================================================================================
+// The loaded magazine is full: move it to previous, handing the latter (if full) to 
+// the chain.
+//________________________________________________________________________________________
+void ThreadCache::spill(Slot& s)
+{
+  if (s.previous_.nCount_)
+    s.pChain_->returnBatch(s.previous_.pFirst_);
+  s.previous_ = s.loaded_;
+  s.loaded_ = Magazine();
+}
+
+//========================================================================================
+// ThreadCache unittests
+//________________________________________________________________________________________
+void test_ThreadCache()
+{
+  ConcurrentPagePool* pool = ConcurrentPagePool::create(true);
+  RG_EXPECT(pool->isThreadCaching());
+  ConcurrentPageChain* chain = pool->getChain(8);
+  ThreadCache& cache = ThreadCache::get();
+
+  // Warm up the chain, so that no Pages get added below:
+  std::vector<void*> blocks;
+  for (size_t j = 0; j < 10 * cnMagazineSize; ++j)
+    blocks.push_back(chain->takeBlock());
+  for (auto b : blocks)
+    chain->returnBlock(b);
+  blocks.clear();
+
+  // Blocks come from the chain in whole batches:
+  void* b1 = pool->takeBlock(8);
+  size_t nFree = chain->countFreeBlocks();
+  blocks.push_back(b1);
+  for (size_t j = 1; j < cnMagazineSize; ++j)
+    blocks.push_back(pool->takeBlock(8));
+  RG_EXPECT(chain->countFreeBlocks() == nFree);
+  blocks.push_back(pool->takeBlock(8));
+  RG_EXPECT(chain->countFreeBlocks() == nFree - cnMagazineSize);
+
+  // ... and go back in whole batches, the last-returned first reused:
+  for (auto b : blocks)
+    pool->returnBlock(b, 8);
+  RG_EXPECT(chain->countFreeBlocks() == nFree - cnMagazineSize);
+  RG_EXPECT(pool->takeBlock(8) == blocks.back());
+  pool->returnBlock(blocks.back(), 8);
+
+  cache.flush();
+  RG_EXPECT(chain->countFreeBlocks() == nFree + cnMagazineSize);
+
+  // Blocks cached by a thread for a pool with deleted Pages are dropped:
+  pool->addRef();
+  for (auto& b : blocks)
+    b = pool->takeBlock(16);
+  for (auto b : blocks)
+    pool->returnBlock(b, 16);
+  pool->release();
+  pool->release();
+  cache.flush(); // Also deletes the pool object
+
+  // Several threads, with more chains than slots, sharing a pool:
+  ConcurrentPrivateAllocator<char> a(true);
+  ConcurrentPagePool* shared = a.pPool_;
+  const size_t cnThreads = 4, cnBlocks = 1000;
+  std::vector<size_t> corrupted(cnThreads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < cnThreads; ++t)
+    threads.emplace_back([&corrupted, shared, t]()
+    {
+      std::vector<std::pair<void*, size_t>> owned;
+      for (size_t j = 0; j < cnBlocks; ++j)
+      {
+        size_t nSize = (j % cnMaxBlockSize_) + 1;
+        void* b = shared->takeBlock(nSize);
+        *(size_t*) b = t * cnBlocks + j;
+        owned.push_back({b, nSize});
+        if (j % 3 == 0) // Return some early
+        {
+          auto& o = owned[j / 2];
+          if (o.first)
+          {
+            corrupted[t] += *(size_t*) o.first != t * cnBlocks + j / 2;
+            shared->returnBlock(o.first, o.second);
+            o.first = nullptr;
+          }
+        }
+      }
+      for (size_t j = 0; j < owned.size(); ++j)
+        if (owned[j].first)
+        {
+          corrupted[t] += *(size_t*) owned[j].first != t * cnBlocks + j;
+          shared->returnBlock(owned[j].first, owned[j].second);
+        }
+    });
+  for (auto& t : threads)
+    t.join();
+  RG_EXPECT(std::count(corrupted.begin(), corrupted.end(), 0) == cnThreads);
+}
+
+RG_ADD_UNITTEST2(test_ThreadCache, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////// ConcurrentPagePool ///////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//========================================================================================
+//________________________________________________________________________________________
+ConcurrentPagePool::ConcurrentPagePool(bool                    bThreadCaching, 
+                                       const BackendAllocator* backend)
+  : nRefCount_(1),
+    nHolderCount_(1),
+    bThreadCaching_(bThreadCaching)
+{
+  for (size_t j = 0; j < cnChainCount; ++j)
+  {
+    aChains_[j].nBlockSize_ = (j + 1) * cnMinAlign;
+    aChains_[j].pBackend_ = backend;
+  }
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+ConcurrentPagePool* ConcurrentPagePool::create(bool                    bThreadCaching,
+                                               const BackendAllocator* backend)
+{
+  void* rawMemory = theBackendAllocator->allocateRaw(sizeof(ConcurrentPagePool));
+  return new (rawMemory) ConcurrentPagePool(bThreadCaching, backend);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+bool ConcurrentPagePool::tryAddRef()
+{
+  size_t n = nRefCount_.load(std::memory_order_relaxed);
+  while (n)
+    if (nRefCount_.compare_exchange_weak(n, n + 1, std::memory_order_acquire))
+      return true;
+  return false;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ConcurrentPagePool::release()
+{
+  if (nRefCount_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+
+  for (auto& c : aChains_)
+    c.deleteAllPages();
+  releaseHolder();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ConcurrentPagePool::releaseHolder()
+{
+  if (nHolderCount_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+
+  this->~ConcurrentPagePool();
+  theBackendAllocator->deallocateRaw(this);
+}
+
+//========================================================================================
+// ConcurrentPagePool unittests
+//________________________________________________________________________________________
+void test_ConcurrentPagePool()
+{
+  ConcurrentPagePool* pool = ConcurrentPagePool::create();
+  RG_EXPECT(!pool->isThreadCaching());
+  RG_EXPECT(pool->getChain(1) == pool->getChain(cnMinAlign));
+  RG_EXPECT(pool->getChain(cnMinAlign + 1)->nBlockSize_ == 2 * cnMinAlign);
+  RG_EXPECT(pool->getChain(cnMaxBlockSize_)->nBlockSize_ == cnMaxBlockSize_);
+
+  void* b1 = pool->takeBlock(8);
+  void* b2 = pool->takeBlock(cnMaxBlockSize_);
+  RG_EXPECT(b1 && b2 && b1 != b2);
+  pool->returnBlock(b1, 8);
+
+  pool->addRef();
+  pool->release();
+  RG_EXPECT(pool->takeBlock(8) == b1); // Still alive
+
+  // A holder keeps the pool object, but not its Pages:
+  pool->addHolder();
+  RG_EXPECT(pool->tryAddRef());
+  pool->release();
+  pool->release();
+  RG_EXPECT(!pool->tryAddRef());
+  pool->releaseHolder();
+}
+
+RG_ADD_UNITTEST2(test_ConcurrentPagePool, 1);
+
+//========================================================================================
+// Unittest for ConcurrentPrivateAllocator<>
+//________________________________________________________________________________________
+void test_ConcurrentPrivateAllocator()
+{
+  typedef ConcurrentPrivateAllocator<int> CPAI;
+
+  CPAI a;
+  RG_EXPECT(a.pPool_);
+  CPAI cpy(a), other;
+  RG_EXPECT(cpy == a && other != a);
+  ConcurrentPrivateAllocator<long> rebound(a);
+  RG_EXPECT(rebound == a);
+
+  int* p = a.allocate(1);
+  long* l = rebound.allocate(1);
+  int* arr = cpy.allocate(100);
+  RG_EXPECT(p && l && arr);
+  a.deallocate(p, 1);
+  RG_EXPECT(cpy.allocate(1) == p);
+  cpy.deallocate(p, 1);
+  rebound.deallocate(l, 1);
+  a.deallocate(arr, 100);
+
+  other = std::move(cpy);
+  RG_EXPECT(other == a);
+  CPAI fresh;
+  other = fresh;
+  RG_EXPECT(other == fresh && other != a);
+
+  // Container copy assignment keeps the destination's allocator:
+  std::list<int, CPAI> src(a), dst(fresh);
+  src.push_back(1);
+  dst = src;
+  RG_EXPECT(dst.get_allocator() == fresh && dst.back() == 1);
+
+  // A list per thread, sharing the clique (made through copies, in the threads):
+  std::vector<std::thread> threads;
+  std::vector<int> results(4); // Not vector<bool>: written concurrently
+  for (size_t j = 0; j < results.size(); ++j)
+    threads.emplace_back([&a, &results, j]()
+    {
+      std::list<int, CPAI> local(a);
+      for (int r = 0; r < 10; ++r)
+      {
+        for (int k = 0; k < 10000; ++k)
+          local.push_back(k);
+        std::set<int, std::less<int>, CPAI> s(local.begin(), local.end(),
+                                              std::less<int>(), a);
+        results[j] = s.size() == 10000 && local.get_allocator() == a;
+        local.clear();
+      }
+    });
+  for (auto& t : threads)
+    t.join();
+  RG_EXPECT(std::count(results.begin(), results.end(), 1) == 4);
+}
+
+RG_ADD_UNITTEST2(test_ConcurrentPrivateAllocator, 2);
+
+} // namespace
+
+
+// Compilability of some of the standard AllocatorAwareContainers with
+// ConcurrentPrivateAllocator<>
+
+template class std::forward_list<int, rg_privateallocator::ConcurrentPrivateAllocator<int>>;
+template class std::list<int, rg_privateallocator::ConcurrentPrivateAllocator<int>>;
+template class std::vector<int, rg_privateallocator::ConcurrentPrivateAllocator<int>>;
+
+// ------------------------ End Of File --------------------------------------
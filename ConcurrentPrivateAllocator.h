@@ -0,0 +1,604 @@
+// ConcurrentPrivateAllocator.h
+//
+// Thread-safe variant of PrivateAllocator<>: copies (and rebound copies) of the same
+// allocator may allocate and deallocate concurrently, from any thread.
+//
+// Author:
+//    Radoslav Getov, getov@mail.com
+
+// ------------------------------------- #Include Guards ---------------------------------
+
+#ifndef RGCPP_CONCURRENTPRIVATEALLOCATOR_H_INCLUDED
+#define RGCPP_CONCURRENTPRIVATEALLOCATOR_H_INCLUDED
+
+// ------------------------------------- #Includes ---------------------------------------
+
+#include "PageAllocator.h"
+#include "BackendAllocators.h"
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstdint> // uint64_t, uintptr_t
+#include <cassert>
+
+// ------------------------------------- Definitions -------------------------------------
+
+namespace rg_privateallocator
+{
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// TaggedBlockPtr ///////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// A FreeBlock pointer and an ABA-protection tag, packed in a single 64-bit word, so
+// that both are compare-and-swapped together.
+// The pointer takes the low 48 bits (user-space addresses on 64-bit platforms usually
+// fit there) or the low 32 bits on 32-bit platforms; the tag takes the rest. Addresses
+// that don't fit (e.g. with 5-level paging, or pointer tagging) can't be packed: 
+// ConcurrentPageChain checks each new Page with canPack(), and falls back to a locked
+// free list for those.
+//________________________________________________________________________________________
+struct TaggedBlockPtr
+{
+  static const unsigned cnPtrBits = sizeof(void*) >= 8 ? 48 : 32;
+  static const uint64_t cnPtrMask = (uint64_t(1) << cnPtrBits) - 1;
+
+  static bool canPack(const void* begin, size_t nByteSize); // All the addresses there
+  static uint64_t pack(FreeBlock* b, uint64_t tag);
+  static FreeBlock* getPtr(uint64_t tagged);
+  static uint64_t getTag(uint64_t tagged);
+};
+
+inline bool TaggedBlockPtr::canPack(const void* begin, size_t nByteSize)
+{
+  return (uint64_t(uintptr_t(begin) + (nByteSize - 1)) & ~cnPtrMask) == 0;
+}
+
+inline uint64_t TaggedBlockPtr::pack(FreeBlock* b, uint64_t tag)
+{
+  assert ((uint64_t(uintptr_t(b)) & ~cnPtrMask) == 0);
+  return uint64_t(uintptr_t(b)) | (tag << cnPtrBits);
+}
+
+inline FreeBlock* TaggedBlockPtr::getPtr(uint64_t tagged)
+{
+  return (FreeBlock*) uintptr_t(tagged & cnPtrMask);
+}
+
+inline uint64_t TaggedBlockPtr::getTag(uint64_t tagged)
+{
+  return tagged >> cnPtrBits;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// BlockLink ////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//****************************************************************************************
+// Access to the next-block link of the free blocks of a ConcurrentPageChain, as a
+// std::atomic<FreeBlock*> (what std::atomic_ref<> does, in C++20).
+// A thread popping the stack reads the link of its head block while another thread
+// may pop that same block, and push it back (or hand it out, and the user overwrite
+// it): the read value is then stale, and the compare-and-swap fails, but the access
+// itself must not be a data race. Relaxed order suffices; the stack head's CAS orders
+// the rest.
+//________________________________________________________________________________________
+struct BlockLink
+{
+  static FreeBlock* load(FreeBlock* b);
+  static void store(FreeBlock* b, FreeBlock* next);
+
+private:
+  static std::atomic<FreeBlock*>& get(FreeBlock* b);
+};
+
+static_assert(sizeof(std::atomic<FreeBlock*>) == sizeof(FreeBlock*) &&
+              alignof(std::atomic<FreeBlock*>) <= cnMinAlign,
+              "std::atomic<FreeBlock*> must overlay FreeBlock::pNextBlock_");
+
+inline std::atomic<FreeBlock*>& BlockLink::get(FreeBlock* b)
+{
+  return *reinterpret_cast<std::atomic<FreeBlock*>*>(&b->pNextBlock_);
+}
+
+inline FreeBlock* BlockLink::load(FreeBlock* b)
+{
+  return get(b).load(std::memory_order_relaxed);
+}
+
+inline void BlockLink::store(FreeBlock* b, FreeBlock* next)
+{
+  get(b).store(next, std::memory_order_relaxed);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////// ConcurrentPageChain //////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+// Block count of a batch (i.e. a full magazine, see ThreadCache)
+const size_t cnMagazineSize = 32;
+
+//****************************************************************************************
+// Thread-safe counterpart of PageChain.
+// The free blocks form a lock-free (Treiber) stack, whose head is tagged against ABA.
+// Only adding a Page takes the mutex: the new Page is carved at once, and its blocks
+// are pushed to the stack in one go.
+// Next to the stack there is a 'depot': a few slots, each holding a batch of 
+// cnMagazineSize linked blocks, so that a ThreadCache exchanges whole batches with a
+// single atomic operation. 
+// Pages are never released before deleteAllPages(), so that a block popped by another
+// thread may still be safely read.
+// Once a Page's addresses can't be packed in the stack head (see TaggedBlockPtr), the
+// chain turns 'locked' for good: the blocks are returned to a plain list guarded by 
+// the mutex, and taken from there once the stack runs out. The links are accessed through BlockLink; the user
+// data written to a block once it is handed out is not atomic, so ThreadSanitizer may
+// still see a stale link read racing with it (the CAS then fails, and the value read
+// is discarded).
+//________________________________________________________________________________________
+class ConcurrentPageChain
+{
+  static const size_t cnDepotSize = 8;
+
+  std::atomic<uint64_t> freeBlocks_;             // TaggedBlockPtr
+  std::atomic<FreeBlock*> apDepot_[cnDepotSize]; // Batches, or nullptr-s
+  std::atomic<bool> bLocked_{false};             // See above
+  std::mutex mutex_;                             // Guards the data below
+  Page* pPage_ = nullptr;                        // The newest Page
+  size_t nPageShift_ = 0;  // Of the newest Page; 0 while there are no Pages
+  FreeBlock* pLockedBlocks_ = nullptr;           // The free blocks, once locked
+
+public:
+  size_t nBlockSize_ = 0;
+  const BackendAllocator* pBackend_ = theBackendAllocator; // Of the Pages
+
+  ConcurrentPageChain();
+
+  void* takeBlock();
+  void returnBlock(void* block);
+
+  FreeBlock* takeBatch();               // Always cnMagazineSize blocks
+  void returnBatch(FreeBlock* first);   // Exactly cnMagazineSize blocks
+  void returnBlocks(FreeBlock* first);  // Any (nullptr-terminated) list
+
+  void deleteAllPages(); // Not thread-safe
+
+  size_t countFreeBlocks(); // Not thread-safe; includes the depot
+  void setLocked();         // As if a Page could not be packed; not thread-safe
+
+private:
+  FreeBlock* popBlock(); // nullptr if there are no free blocks
+  void* takeBlockFromNewPage();
+  void pushBlocks(FreeBlock* first, FreeBlock* last);
+  void pushBlocksLocked(FreeBlock* first, FreeBlock* last); // The mutex held
+  bool pushToDepot(FreeBlock* batch);
+  FreeBlock* popFromDepot();
+};
+
+inline void* ConcurrentPageChain::takeBlock()
+{
+  if (FreeBlock* b = popBlock())
+    return b;
+  return takeBlockFromNewPage();
+}
+
+inline FreeBlock* ConcurrentPageChain::popBlock()
+{
+  uint64_t head = freeBlocks_.load(std::memory_order_acquire);
+  while (FreeBlock* b = TaggedBlockPtr::getPtr(head))
+  {
+    uint64_t next = TaggedBlockPtr::pack(BlockLink::load(b),
+                                         TaggedBlockPtr::getTag(head) + 1);
+    if (freeBlocks_.compare_exchange_weak(head,
+                                          next,
+                                          std::memory_order_acquire,
+                                          std::memory_order_acquire))
+      return b;
+  }
+  return nullptr;
+}
+
+inline void ConcurrentPageChain::returnBlock(void* block)
+{
+  assert (block);
+  pushBlocks((FreeBlock*) block, (FreeBlock*) block);
+}
+
+inline void ConcurrentPageChain::pushBlocks(FreeBlock* first, FreeBlock* last)
+{
+  if (bLocked_.load(std::memory_order_relaxed))
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pushBlocksLocked(first, last);
+  }
+  uint64_t head = freeBlocks_.load(std::memory_order_relaxed);
+  do
+    BlockLink::store(last, TaggedBlockPtr::getPtr(head));
+  while (!freeBlocks_.compare_exchange_weak(
+            head,
+            TaggedBlockPtr::pack(first, TaggedBlockPtr::getTag(head) + 1),
+            std::memory_order_release,
+            std::memory_order_relaxed));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////// ConcurrentPagePool ///////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// The state shared by a clique of ConcurrentPrivateAllocator<>s; reference-counted.
+// Has a ConcurrentPageChain for each block size (i.e. multiple of cnMinAlign) up to
+// cnMaxBlockSize_, so that no chain is ever added concurrently.
+// There are two counts:
+//   - references (by allocators): the Pages are deleted when they drop to 0;
+//   - holders (all references, together, as 1; and each ThreadCache slot): the pool
+//     object itself is deleted when they drop to 0.
+//________________________________________________________________________________________
+class ConcurrentPagePool
+{
+  static const size_t cnChainCount = cnMaxBlockSize_ / cnMinAlign;
+
+  std::atomic<size_t> nRefCount_;
+  std::atomic<size_t> nHolderCount_;
+  bool bThreadCaching_;
+  ConcurrentPageChain aChains_[cnChainCount];
+
+public:
+  ConcurrentPagePool(bool bThreadCaching, const BackendAllocator* backend);
+
+  // With reference count of 1; the Pages come from 'backend':
+  static ConcurrentPagePool* create(
+    bool bThreadCaching = false, 
+    const BackendAllocator* backend = theBackendAllocator); 
+  void addRef();
+  bool tryAddRef(); // Fails once the Pages are deleted
+  void release();   // Deletes all the Pages upon the last release
+  void addHolder();
+  void releaseHolder();
+
+  bool isThreadCaching() const { return bThreadCaching_; }
+
+  ConcurrentPageChain* getChain(size_t nUserSize);
+  void* takeBlock(size_t nUserSize);
+  void returnBlock(void* block, size_t nUserSize);
+};
+
+inline void ConcurrentPagePool::addRef()
+{
+  nRefCount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void ConcurrentPagePool::addHolder()
+{
+  nHolderCount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline ConcurrentPageChain* ConcurrentPagePool::getChain(size_t nUserSize)
+{
+  assert (nUserSize > 0 && nUserSize <= cnMaxBlockSize_);
+  return &aChains_[(nUserSize - 1) / cnMinAlign];
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// ThreadCache //////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//****************************************************************************************
+// A list of up to cnMagazineSize free blocks, private to a thread.
+//________________________________________________________________________________________
+struct Magazine
+{
+  FreeBlock* pFirst_ = nullptr;
+  size_t nCount_ = 0;
+
+  void* pop();
+  void push(void* block);
+};
+
+inline void* Magazine::pop()
+{
+  assert (nCount_ > 0);
+  FreeBlock* b = pFirst_;
+  pFirst_ = BlockLink::load(b);
+  --nCount_;
+  return b;
+}
+
+inline void Magazine::push(void* block)
+{
+  assert (nCount_ < cnMagazineSize);
+  auto b = (FreeBlock*) block;
+  BlockLink::store(b, pFirst_);
+  pFirst_ = b;
+  ++nCount_;
+}
+
+//****************************************************************************************
+// Per-thread magazines in front of the ConcurrentPageChain-s of thread-caching pools.
+// Single blocks are taken from, and returned to, a thread's own magazines without any
+// atomic operations; only whole batches are exchanged with the chain's depot.
+// Each (direct-mapped) slot serves one chain, with a 'loaded' and a 'previous' 
+// magazine; the latter is always either empty or full, so that alternating 
+// allocations and deallocations around a batch boundary don't reach the chain.
+// A slot holds its pool (see ConcurrentPagePool), so that a chain address is never 
+// reused while cached. The blocks are returned to the chain when the slot gets 
+// claimed by another chain, or when the thread exits - unless the pool's Pages
+// have been deleted meanwhile.
+//________________________________________________________________________________________
+class ThreadCache
+{
+  static const size_t cnSlotCount = 16;
+
+  struct Slot
+  {
+    ConcurrentPagePool* pPool_ = nullptr;
+    ConcurrentPageChain* pChain_ = nullptr;
+    Magazine loaded_;
+    Magazine previous_;
+  };
+
+  Slot aSlots_[cnSlotCount];
+
+public:
+  ~ThreadCache();
+
+  static ThreadCache& get(); // Of the calling thread
+
+  void* takeBlock(ConcurrentPagePool* pool, ConcurrentPageChain* chain);
+  void returnBlock(ConcurrentPagePool* pool, ConcurrentPageChain* chain, void* block);
+
+  void flush(); // Return all cached blocks
+
+private:
+  Slot& getSlot(ConcurrentPagePool* pool, ConcurrentPageChain* chain);
+  void claimSlot(Slot& s, ConcurrentPagePool* pool, ConcurrentPageChain* chain);
+  void flushSlot(Slot& s);
+  static void refill(Slot& s);
+  static void spill(Slot& s);
+};
+
+inline ThreadCache& ThreadCache::get()
+{
+  static thread_local ThreadCache cache;
+  return cache;
+}
+
+inline ThreadCache::Slot& ThreadCache::getSlot(ConcurrentPagePool* pool,
+                                               ConcurrentPageChain* chain)
+{
+  Slot& s = aSlots_[uintptr_t(chain) / sizeof(ConcurrentPageChain) % cnSlotCount];
+  if (s.pChain_ != chain)
+    claimSlot(s, pool, chain);
+  return s;
+}
+
+inline void* ThreadCache::takeBlock(ConcurrentPagePool* pool, 
+                                    ConcurrentPageChain* chain)
+{
+  Slot& s = getSlot(pool, chain);
+  if (s.loaded_.nCount_ == 0)
+    refill(s);
+  return s.loaded_.pop();
+}
+
+inline void ThreadCache::returnBlock(ConcurrentPagePool* pool, 
+                                     ConcurrentPageChain* chain,
+                                     void* block)
+{
+  Slot& s = getSlot(pool, chain);
+  if (s.loaded_.nCount_ == cnMagazineSize)
+    spill(s);
+  s.loaded_.push(block);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+inline void* ConcurrentPagePool::takeBlock(size_t nUserSize)
+{
+  ConcurrentPageChain* chain = getChain(nUserSize);
+  return bThreadCaching_ 
+           ? ThreadCache::get().takeBlock(this, chain) 
+           : chain->takeBlock();
+}
+
+inline void ConcurrentPagePool::returnBlock(void* block, size_t nUserSize)
+{
+  ConcurrentPageChain* chain = getChain(nUserSize);
+  if (bThreadCaching_)
+    ThreadCache::get().returnBlock(this, chain, block);
+  else
+    chain->returnBlock(block);
+}
+
+//****************************************************************************************
+// Thread-safe PrivateAllocator<>. Same semantics, except that:
+//   - the clique state (ConcurrentPagePool) is created along with the allocator, and
+//     shared by reference count, so that copies may be made concurrently;
+//   - arrays are not cached; they go straight to the backend;
+//   - optionally, single blocks are cached per thread (see ThreadCache).
+// 'Backend' (see BackendAllocators.h) provides the Pages and the arrays; it is called 
+// directly for the latter.
+//________________________________________________________________________________________
+template <typename T, typename Backend = NewDeleteBackend>
+class ConcurrentPrivateAllocator
+{
+public:
+// See https://en.cppreference.com/w/cpp/named_req/Allocator
+  using value_type = T;
+
+// Ctors, dtor:
+  ConcurrentPrivateAllocator();
+  explicit ConcurrentPrivateAllocator(bool bThreadCaching);
+  ConcurrentPrivateAllocator(const ConcurrentPrivateAllocator& from) noexcept;
+
+  template <typename Other>
+  explicit ConcurrentPrivateAllocator(
+    const ConcurrentPrivateAllocator<Other, Backend>& other)
+    noexcept;
+
+  ~ConcurrentPrivateAllocator();
+
+// Assignments (as in PrivateAllocator<>):
+  // Move: used in container move assignment. Shares rhs's pool.
+  void operator = (ConcurrentPrivateAllocator&& rhs) noexcept;
+
+  // Copy: shares rhs's pool, as the copy ctor does. Not used by containers (see 
+  // propagate_on_container_copy_assignment).
+  void operator = (const ConcurrentPrivateAllocator& rhs) noexcept;
+
+// Allocation/deallocation:
+  T* allocate(size_t n);
+  void deallocate(T* p, size_t n) noexcept;
+
+// Implement 'Allocator concept' flags (as in PrivateAllocator<>):
+  using is_always_equal = std::false_type;
+  ConcurrentPrivateAllocator select_on_container_copy_construction() const;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_swap = std::true_type;
+
+// Implementation
+private:
+  static const size_t cnBlockSize_ = sizeof(T);
+  bool shouldUsePageAllocation(size_t n);
+
+public: // Used in global operator==() and by rebound copies
+  ConcurrentPagePool* pPool_;
+};
+
+//========================================================================================
+// Equality operators as per https://en.cppreference.com/w/cpp/named_req/Allocator
+//________________________________________________________________________________________
+template <class T, class U, class Backend>
+bool operator == (ConcurrentPrivateAllocator<T, Backend> const& lhs,
+                  ConcurrentPrivateAllocator<U, Backend> const& rhs) noexcept
+{
+  return lhs.pPool_ == rhs.pPool_;
+}
+
+template <class T, class U, class Backend>
+bool operator != (ConcurrentPrivateAllocator<T, Backend> const& lhs,
+                  ConcurrentPrivateAllocator<U, Backend> const& rhs) noexcept
+{
+  return !(lhs == rhs);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+ConcurrentPrivateAllocator<T, Backend>::ConcurrentPrivateAllocator()
+  : pPool_(ConcurrentPagePool::create(false, &BackendAdapter<Backend>::instance))
+{
+}
+
+//========================================================================================
+// With 'bThreadCaching', the clique caches single blocks per thread (see ThreadCache).
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+ConcurrentPrivateAllocator<T, Backend>::ConcurrentPrivateAllocator(bool bThreadCaching)
+  : pPool_(ConcurrentPagePool::create(bThreadCaching, 
+                                      &BackendAdapter<Backend>::instance))
+{
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+ConcurrentPrivateAllocator<T, Backend>::ConcurrentPrivateAllocator(
+  const ConcurrentPrivateAllocator& from) noexcept
+  : pPool_(from.pPool_)
+{
+  pPool_->addRef();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+template <typename Other>
+ConcurrentPrivateAllocator<T, Backend>::ConcurrentPrivateAllocator(
+  const ConcurrentPrivateAllocator<Other, Backend>& from) noexcept
+  : pPool_(from.pPool_)
+{
+  pPool_->addRef();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+ConcurrentPrivateAllocator<T, Backend>::~ConcurrentPrivateAllocator()
+{
+  pPool_->release();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+void ConcurrentPrivateAllocator<T, Backend>::operator = (ConcurrentPrivateAllocator&& rhs) noexcept
+{
+  *this = static_cast<const ConcurrentPrivateAllocator&>(rhs);
+}
+
+//========================================================================================
+// The reference is added first, so that self-assignment keeps the pool.
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+void ConcurrentPrivateAllocator<T, Backend>::operator = (const ConcurrentPrivateAllocator& rhs) noexcept
+{
+  rhs.pPool_->addRef();
+  pPool_->release();
+  pPool_ = rhs.pPool_;
+}
+
+//========================================================================================
+// The only requests serverd by the Page allocator are for single blocks that are
+// small enough.
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+inline bool ConcurrentPrivateAllocator<T, Backend>::shouldUsePageAllocation(size_t n)
+{
+  return n == 1 && cnBlockSize_ <= cnMaxBlockSize_;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+T* ConcurrentPrivateAllocator<T, Backend>::allocate(size_t n)
+{
+  if (shouldUsePageAllocation(n))
+    return static_cast<T*>(pPool_->takeBlock(cnBlockSize_));
+  statsAddFallback();
+  if (alignof(T) > cnMaxAlign) // Over-aligned (see PrivateAllocator<>)
+    return static_cast<T*>(Backend::allocateAlignedRaw(n * cnBlockSize_, alignof(T)));
+  return static_cast<T*>(Backend::allocateRaw(n * cnBlockSize_));
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+void ConcurrentPrivateAllocator<T, Backend>::deallocate(T* p, size_t n) noexcept
+{
+  if (shouldUsePageAllocation(n))
+    pPool_->returnBlock(p, cnBlockSize_);
+  else if (alignof(T) > cnMaxAlign)
+    Backend::deallocateAlignedRaw(p, n * cnBlockSize_);
+  else
+    Backend::deallocateRaw(p);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend>
+ConcurrentPrivateAllocator<T, Backend>
+  ConcurrentPrivateAllocator<T, Backend>::select_on_container_copy_construction() const
+{
+  return ConcurrentPrivateAllocator(pPool_->isThreadCaching());
+}
+
+// -------------------------------- End Of File ------------------------------------------
+
+} // namespace rg_privateallocator
+
+#endif // #include guard
@@ -13,8 +13,12 @@
 #include "Unittest.h"
 
 #include <algorithm> // min/max 
+#include <functional> // std::less
 #include <cassert>  
 #include <utility>
+#include <new> // placement new
+#include <vector>
+#include <thread>
 
 // --------------------------- Definitions -------------------------------------
 
@@ -43,6 +47,41 @@ size_t calcAligmentForPtr(const void* ptr)
   return calcAligmentForSize(size_t(ptr));
 }
 
+//========================================================================================
+// Vectors of 4 (AVX2) or 2 (SSE2) words are tested at once, from the first of them 
+// aligned to its size; the words around them are tested one by one.
+//________________________________________________________________________________________
+size_t findNonZeroWord(const uint64_t* words, size_t nBegin, size_t nEnd)
+{
+  size_t j = nBegin;
+  #if RG_PRIVATEALLOCATOR_SIMD
+    #if RG_PRIVATEALLOCATOR_SIMD >= 2
+      const size_t cnVectorWords = 4;
+    #else
+      const size_t cnVectorWords = 2;
+    #endif
+    for (/**/; j < nEnd && (size_t(words + j) & (cnVectorWords * 8 - 1)); ++j)
+      if (words[j])
+        return j;
+    for (/**/; j + cnVectorWords <= nEnd; j += cnVectorWords)
+    {
+      #if RG_PRIVATEALLOCATOR_SIMD >= 2
+        __m256i v = _mm256_load_si256((const __m256i*) (words + j));
+        if (!_mm256_testz_si256(v, v))
+          break;
+      #else
+        __m128i v = _mm_load_si128((const __m128i*) (words + j));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF)
+          break;
+      #endif
+    }
+  #endif
+  for (/**/; j < nEnd; ++j)
+    if (words[j])
+      return j;
+  return nEnd;
+}
+
 //========================================================================================
 // Unittests for free functions
 //________________________________________________________________________________________
@@ -71,30 +110,88 @@ RG_ADD_UNITTEST2(test_PageAllocator_Simple, 1);
 
 
 //////////////////////////////////////////////////////////////////////////////////////////
-/////////////////////////////////////// SimplePageHeader /////////////////////////////
+/////////////////////////////////////// Statistics ///////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 
-// Direct/low-level data get/set
-void SimplePageHeader::setBlockSize(size_t nBlockSize)
+static thread_local StatsCounters<size_t> theThreadStats;
+static StatsCounters<std::atomic<size_t>> theProcessStats;
+
+//========================================================================================
+//________________________________________________________________________________________
+void statsAddBackendPage(size_t nByteSize)
+{
+  theThreadStats.addPage(nByteSize);
+  theProcessStats.addPage(nByteSize);
+}
+
+void statsRemoveBackendPage(size_t nByteSize)
+{
+  theThreadStats.removePages(1, nByteSize);
+  theProcessStats.removePages(1, nByteSize);
+}
+
+void statsAddFallback()
 {
-  nBlockSize_ = nBlockSize;
+  theThreadStats.addFallback();
+  theProcessStats.addFallback();
 }
 
-void SimplePageHeader::setNextPage(Page* p)
+//========================================================================================
+//________________________________________________________________________________________
+AllocatorStats getThreadStats()
 {
-  pNextPage_ = p;
+  AllocatorStats ret;
+  #if RG_PRIVATEALLOCATOR_STATS
+    theThreadStats.addTo(&ret);
+  #endif
+  return ret;
 }
-  
-Page* SimplePageHeader::getNextPage()
+
+AllocatorStats getProcessStats()
 {
-  return pNextPage_;
+  AllocatorStats ret;
+  #if RG_PRIVATEALLOCATOR_STATS
+    theProcessStats.addTo(&ret);
+  #endif
+  return ret;
 }
 
-void SimplePageHeader::setFirstBlock(FreeBlock* b)
+//========================================================================================
+// Statistics unittests
+//________________________________________________________________________________________
+void test_StatsCounters()
 {
-  pFirstBlock_ = b;
+  StatsCounters<size_t> counters;
+  counters.addPage(100);
+  counters.addPage(200);
+  counters.removePages(1, 100);
+  counters.addFallback();
+  AllocatorStats stats;
+  counters.addTo(&stats);
+  #if RG_PRIVATEALLOCATOR_STATS
+    RG_EXPECT(stats.nPages == 1 && stats.nPageBytes == 200);
+    RG_EXPECT(stats.nPeakPageBytes == 300 && stats.nFallbacks == 1);
+  #else
+    RG_EXPECT(stats.nPages == 0 && stats.nPeakPageBytes == 0 && stats.nFallbacks == 0);
+  #endif
+
+  StatsCounters<std::atomic<size_t>> atomicCounters;
+  atomicCounters.addPage(100);
+  atomicCounters.removePages(1, 100);
+  atomicCounters.addPage(50);
+  stats = AllocatorStats();
+  atomicCounters.addTo(&stats);
+  RG_EXPECT(stats.nPageBytes == (RG_PRIVATEALLOCATOR_STATS ? 50 : 0));
+  RG_EXPECT(stats.nPeakPageBytes == (RG_PRIVATEALLOCATOR_STATS ? 100 : 0));
 }
 
+RG_ADD_UNITTEST2(test_StatsCounters, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// SimplePageHeader /////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
 //========================================================================================
 // SimplePageHeader unittests
 //________________________________________________________________________________________
@@ -119,27 +216,6 @@ RG_ADD_UNITTEST2(test_SimplePageHeader, 1);
 ////////////////////////////// PackedPageHeader //////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 
-void PackedPageHeader::setBlockSize(size_t nBlockSize)
-{
-  nBlockSizeLSB_ = (nBlockSize >> 3) & 0x7;
-  nBlockSizeMSB_ = nBlockSize >> 6;
-}
-
-void PackedPageHeader::setNextPage(Page* p)
-{
-  nNextPageMSB_ = size_t(p) >> 3;
-}
-  
-Page* PackedPageHeader::getNextPage()
-{
-  return (Page*) (nNextPageMSB_ << 3);
-}
-
-void PackedPageHeader::setFirstBlock(FreeBlock* b)
-{
-  nFirstBlockMSB_ = size_t(b) >> 3;
-}
-
 //========================================================================================
 // PackedPageHeader unittests
 //________________________________________________________________________________________
@@ -159,6 +235,15 @@ void test_PackedPageHeader()
   RG_EXPECT(phi.getNextPage() == &ph);
   RG_EXPECT(phi.getFirstBlock() == &bh);
   RG_EXPECT(phi.getBlockSize() == 64);
+
+  phi.setPageShift(cnMaxPageShift_);
+  phi.setLiveBlockCount(10);
+  phi.setBumpOffset(cnMaxPageByteSize_);
+  phi.setFirstBlockOffset(cnMaxBlockSize_ * cnMaxPageColors_);
+  RG_EXPECT(phi.getPageShift() == cnMaxPageShift_ && phi.getLiveBlockCount() == 10);
+  RG_EXPECT(phi.getBumpOffset() == cnMaxPageByteSize_);
+  RG_EXPECT(phi.getFirstBlockOffset() == cnMaxBlockSize_ * cnMaxPageColors_);
+  RG_EXPECT(phi.getFirstBlock() == &bh && phi.getBlockSize() == 64);
 }
 
 RG_ADD_UNITTEST2(test_PackedPageHeader, 1);
@@ -170,43 +255,86 @@ RG_ADD_UNITTEST2(test_PackedPageHeader, 1);
 
 //========================================================================================
 //________________________________________________________________________________________
-void Page::initialize(size_t nBlockSize, size_t nBlockCount, Page* pagesSoFar)
+template <typename PageHeader>
+void BasicPage<PageHeader>::initialize(size_t     nBlockSize, 
+                                       size_t     nPageShift, 
+                                       BasicPage* pagesSoFar,
+                                       size_t     nPageColors)
 {
   // The layout of Page is:
-  // <Page><FreeBlock...><FreeBlock...>....<FreeBlock>.
-
-  assert (nBlockSize > 0 && nBlockCount > 0);
-
-  // Chain the available memory as FreeBlocks
-  char* pFirstBlock = (char*)this + sizeof(*this);
-  char* pLastBlock = pFirstBlock + nBlockSize * (nBlockCount - 1);
-  for (char* b = pFirstBlock, *next = b + nBlockSize; 
-       /**/; 
-       b = next, next = b + nBlockSize)
-  {
-    FreeBlock* bh = (FreeBlock*) b;
-    if (b != pLastBlock)
-    { 
-      bh->pNextBlock_ = (FreeBlock*) next;
-      continue;
-    }
-    FreeBlock* existingBlocks = pagesSoFar 
-                                  ? pagesSoFar->header_.getFirstBlock() 
-                                  : nullptr;
-    bh->pNextBlock_ = existingBlocks;
-    break;
-  }
+  // <Page><color padding><FreeBlock...><FreeBlock...>....<FreeBlock>.
+
+  size_t nOffset = calcFirstBlockOffset(nBlockSize) + 
+                     calcColorOffset(this, nBlockSize, nPageShift, nPageColors);
+  assert (nOffset + nBlockSize <= size_t(1) << nPageShift);
+  assert (!pagesSoFar || !pagesSoFar->hasFreeBlocks()); // So, nothing to take over
 
+  // The blocks are left untouched; they are carved by takeBlock()
   header_.setBlockSize(nBlockSize);
   header_.setNextPage(pagesSoFar);
-  header_.setFirstBlock((FreeBlock*) pFirstBlock);
+  header_.setFirstBlock(nullptr);
+  header_.setPageShift(nPageShift);
+  header_.setLiveBlockCount(0);
+  header_.setFirstBlockOffset(nOffset);
+  header_.setBumpOffset(nOffset);
 }
 
 //========================================================================================
+// The color comes from the Page address bits just above the Page size, so that the
+// Pages of a size (aligned alike) are spread over the colors, without any state.
+// The step keeps the blocks aligned (see calcFirstBlockOffset()).
 //________________________________________________________________________________________
-size_t Page::countFreeBlocks()
+template <typename PageHeader>
+size_t BasicPage<PageHeader>::calcColorOffset(const void* page, 
+                                              size_t      nBlockSize, 
+                                              size_t      nPageShift, 
+                                              size_t      nPageColors)
 {
-  size_t nRet = 0;
+  assert (nPageColors > 0 && nPageColors <= cnMaxPageColors_ && 
+          (nPageColors & (nPageColors - 1)) == 0);
+  size_t nStep = std::max(cnCacheLineSize, nBlockSize & (0 - nBlockSize));
+  if (nPageColors * nStep > (size_t(1) << nPageShift) / 8)
+    return 0; // Too small a Page
+  return ((size_t(page) >> nPageShift) & (nPageColors - 1)) * nStep;
+}
+
+//========================================================================================
+// The untouched blocks go first, in address order.
+//________________________________________________________________________________________
+template <typename PageHeader>
+FreeBlock* BasicPage<PageHeader>::detachFreeBlocks()
+{
+  FreeBlock* pRet = header_.getFirstBlock();
+  size_t nBlockSize = getBlockSize(),
+         nOffset = header_.getBumpOffset(),
+         nEnd = nOffset + countUntouchedBlocks() * nBlockSize;
+  for (size_t n = nEnd; n > nOffset; /**/)
+  {
+    n -= nBlockSize;
+    FreeBlock* b = (FreeBlock*) ((char*) this + n);
+    b->pNextBlock_ = pRet;
+    pRet = b;
+  }
+  header_.setBumpOffset(nEnd);
+  header_.setFirstBlock(nullptr);
+  return pRet;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename PageHeader>
+void BasicPage<PageHeader>::attachFreeBlocks(FreeBlock* list)
+{
+  assert (!header_.getFirstBlock());
+  header_.setFirstBlock(list);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename PageHeader>
+size_t BasicPage<PageHeader>::countFreeBlocks()
+{
+  size_t nRet = countUntouchedBlocks();
   for (auto b = header_.getFirstBlock(); b; b = b->pNextBlock_)
     ++nRet;
   return nRet;
@@ -216,71 +344,254 @@ size_t Page::countFreeBlocks()
 // The smallest page should have at least one block but could have more due to 
 // small user size and mandatory padding
 //________________________________________________________________________________________
-size_t Page::calcMinBlockCount(size_t nBlockSize)
+template <typename PageHeader>
+size_t BasicPage<PageHeader>::calcMinBlockCount(size_t nBlockSize)
 {
   // Use at least as much memory as Page
-  if (nBlockSize >= sizeof(Page))
+  if (nBlockSize >= sizeof(BasicPage))
     return 1;
   else
-    return sizeof(Page) / nBlockSize; // Round 'down'
+    return sizeof(BasicPage) / nBlockSize; // Round 'down'
 }
 
 //========================================================================================
-// Calculates the size (count of blocks) of the next page to be created.
+// The size (log2 of the byte size) of the 1st page: the smallest power of 2 fitting 
+// the header and the minimal count of blocks.
 //________________________________________________________________________________________
-size_t Page::calcNewPageBlockCount(size_t nBlockSize, Page* pagesSoFar)
+template <typename PageHeader>
+size_t BasicPage<PageHeader>::calcFirstPageShift(size_t nBlockSize)
 {
-  size_t nFirstPageCount = calcMinBlockCount(nBlockSize);
-  if (!pagesSoFar) // so, 1st page ever
-    return nFirstPageCount;
-
-  // Page sizes grow exponentially
-  size_t nMaxPageBlockCount = (cnMaxPageByteSize_ - sizeof(Page)) / nBlockSize,
-         nRet = nFirstPageCount;
-  for (Page *page = pagesSoFar; page; page = page->header_.getNextPage())
-  {
-    nRet *= 2;
-    if (nRet >= nMaxPageBlockCount)
-      return nMaxPageBlockCount;
-  }
-
+  size_t nMinByteSize = calcFirstBlockOffset(nBlockSize) + 
+                          calcMinBlockCount(nBlockSize) * nBlockSize,
+         nRet = cnMinPageShift_;
+  while ((size_t(1) << nRet) < nMinByteSize)
+    ++nRet;
+  assert (nRet <= cnMaxPageShift_);
   return nRet;
 }
 
 //========================================================================================
-// Creates a new Page of the appropriate size, and chains in in front of 'pagesSoFar'.
+// Page sizes grow exponentially: each new Page is 2^nGrowthShift times (by default,
+// twice) larger than the previous one, up to 2^nMaxPageShift bytes.
+//________________________________________________________________________________________
+template <typename PageHeader>
+size_t BasicPage<PageHeader>::calcNextPageShift(size_t nPageShift, 
+                                                size_t nMaxPageShift, 
+                                                size_t nGrowthShift)
+{
+  assert (nMaxPageShift >= cnMinPageShift_ && nMaxPageShift <= cnMaxHugePageShift_);
+  assert (nPageShift >= cnMinPageShift_ && nPageShift <= nMaxPageShift);
+  assert (nGrowthShift > 0);
+  return std::min(nPageShift + nGrowthShift, nMaxPageShift);
+}
+
+//========================================================================================
+// Creates a new Page of size 2^nPageShift bytes, and chains in in front of 'pagesSoFar'.
+// The Page is aligned to its byte size.
 // Returns pointer to the new Page.
 //________________________________________________________________________________________
-Page* Page::addNewPage(size_t nUserSize, Page* pagesSoFar)
+template <typename PageT>
+PageT* BasicPageList<PageT>::addNewPage(size_t                  nBlockSize, 
+                                        size_t                  nPageShift, 
+                                        PageT*                  pagesSoFar,
+                                        const BackendAllocator* backend,
+                                        size_t                  nPageColors)
 {
-  size_t nBlockSize = pagesSoFar
-                        ? pagesSoFar->getBlockSize()
-                        : roundUp(nUserSize, cnMinAlign);
-  assert (!pagesSoFar || pagesSoFar->getBlockSize() >= nUserSize);
+  assert (nBlockSize == roundUp(nBlockSize, cnMinAlign));
+  assert (!pagesSoFar || pagesSoFar->getBlockSize() == nBlockSize);
 
-  size_t nBlockCount = calcNewPageBlockCount(nBlockSize, pagesSoFar);
-  size_t nByteSize = nBlockCount * nBlockSize;
-  void* rawMemory = theBackendAllocator->allocateRaw(sizeof(Page) + nByteSize);
-  assert(calcAligmentForPtr(rawMemory) >= cnMaxAlign);
+  void* rawMemory = PageCache::allocatePage(nPageShift, backend);
+  assert(PageT::alignDown(rawMemory, nPageShift) == rawMemory);
 
-  Page* ret = (Page*) rawMemory;
-  ret->initialize(nBlockSize, nBlockCount, pagesSoFar);
+  PageT* ret = (PageT*) rawMemory;
+  ret->initialize(nBlockSize, nPageShift, pagesSoFar, nPageColors);
   return ret;
 }
 
 //========================================================================================
-// Delete a linked-list of pagesSoFar.
+// Delete a linked-list of pagesSoFar, through the thread's PageCache.
 //________________________________________________________________________________________
-void Page::deleteAllPages(Page* pagesSoFar)
+template <typename PageT>
+void BasicPageList<PageT>::deleteAllPages(PageT*                  pagesSoFar, 
+                                          const BackendAllocator* backend)
 {
   while (pagesSoFar)
   {
-    Page* next = pagesSoFar->header_.getNextPage();
-    theBackendAllocator->deallocateRaw(pagesSoFar);
+    PageT* next = pagesSoFar->getNextPage();
+    PageCache::deallocatePage(pagesSoFar, pagesSoFar->getPageShift(), backend);
     pagesSoFar = next;
   }
 }
 
+//========================================================================================
+//________________________________________________________________________________________
+template <typename PageT>
+size_t BasicPageList<PageT>::countPages(PageT* pFirstPage)
+{
+  size_t nRet = 0;
+  for (PageT* p = pFirstPage; p; p = p->getNextPage())
+    ++nRet;
+  return nRet;
+}
+
+//========================================================================================
+// Deletes the Pages (of the list starting at 'pFirstPage') whose blocks are all free.
+// The free-block list, kept in the first Page, is re-linked without the blocks of the
+// deleted Pages, and handed over to the new first Page. The deleted Pages are removed
+// from 'pTable'.
+// Sets the live-block count of the remaining Pages, and '*pnReclaimedBlocks' to the
+// count of blocks of the deleted ones. Returns the new first Page (nullptr if none).
+// The deleted Pages go straight to the backend (not to the PageCache), since freeing
+// memory is the point of reclaiming.
+//________________________________________________________________________________________
+template <typename PageHeader>
+BasicPage<PageHeader>* 
+BasicPage<PageHeader>::reclaimFreePages(BasicPage*                 pFirstPage, 
+                                        BasicPageTable<BasicPage>* pTable,
+                                        size_t*                    pnReclaimedBlocks,
+                                        const BackendAllocator*    backend)
+{
+  assert (pnReclaimedBlocks);
+  assert (pTable || !pFirstPage || !pFirstPage->getNextPage());
+  *pnReclaimedBlocks = 0;
+  if (!pFirstPage)
+    return nullptr;
+
+  auto findPage = [=](const void* block)
+  {
+    return pTable ? pTable->findPage(block) : pFirstPage;
+  };
+
+  // Live count = block count - untouched count - free count:
+  for (BasicPage* p = pFirstPage; p; p = p->getNextPage())
+    p->header_.setLiveBlockCount(p->getBlockCount() - p->countUntouchedBlocks());
+  FreeBlock* pFreeBlocks = pFirstPage->header_.getFirstBlock();
+  for (FreeBlock* b = pFreeBlocks; b; b = b->pNextBlock_)
+  {
+    BasicPage* p = findPage(b);
+    assert ((char*) b > (char*) p && (char*) b < (char*) p + p->getByteSize());
+    p->header_.setLiveBlockCount(p->getLiveBlockCount() - 1);
+  }
+
+  // Drop the free blocks of the fully-free Pages:
+  FreeBlock** ppNext = &pFreeBlocks;
+  while (FreeBlock* b = *ppNext)
+    if (findPage(b)->getLiveBlockCount() == 0)
+      *ppNext = b->pNextBlock_;
+    else
+      ppNext = &b->pNextBlock_;
+
+  // Unlink and delete the fully-free Pages:
+  BasicPage *pRet = nullptr, 
+       *pLast = nullptr;
+  for (BasicPage* p = pFirstPage; p; /**/)
+  {
+    BasicPage* next = p->getNextPage();
+    if (p->getLiveBlockCount() == 0)
+    {
+      *pnReclaimedBlocks += p->getBlockCount();
+      if (pTable)
+        pTable->removePage(p);
+      statsRemoveBackendPage(p->getByteSize());
+      backend->deallocateAlignedRaw(p, p->getByteSize());
+    }
+    else 
+    {
+      if (pLast)
+        pLast->header_.setNextPage(p);
+      else
+        pRet = p;
+      pLast = p;
+    }
+    p = next;
+  }
+
+  // The new first Page keeps the free-block list:
+  if (pLast)
+  {
+    pLast->header_.setNextPage(nullptr);
+    pRet->header_.setFirstBlock(pFreeBlocks);
+  }
+  else
+    assert (!pFreeBlocks);
+  return pRet;
+}
+
+//========================================================================================
+// Relinks the free list of a chain (held by 'pFirstPage') in address order, Page by 
+// Page: the free blocks are marked in a bitmap, a word-aligned range per Page, and the 
+// list is rebuilt by scanning the bitmap. The Page of a block is found by binary search
+// among the Pages, sorted by address.
+// The Page list and bitmap are temporary, from theBackendAllocator.
+//________________________________________________________________________________________
+template <typename PageHeader>
+void BasicPage<PageHeader>::sortFreeBlocks(BasicPage* pFirstPage)
+{
+  if (!pFirstPage || !pFirstPage->header_.getFirstBlock())
+    return;
+
+  const size_t cnWordBits = 8 * sizeof(size_t);
+  size_t nPages = BasicPage::countPages(pFirstPage),
+         nWords = 0;
+  for (BasicPage* p = pFirstPage; p; p = p->getNextPage())
+    nWords += (p->getBlockCount() + cnWordBits - 1) / cnWordBits;
+  void* rawMemory = theBackendAllocator->allocateRaw((2 * nPages + nWords) * sizeof(size_t));
+  auto apPages = (BasicPage**) rawMemory;
+  auto anFirstWords = (size_t*) (apPages + nPages);
+  auto anBitmap = anFirstWords + nPages;
+
+  // The Pages by address, each with its first bitmap word:
+  size_t j = 0;
+  for (BasicPage* p = pFirstPage; p; p = p->getNextPage())
+    apPages[j++] = p;
+  std::less<BasicPage*> isBefore;
+  std::sort(apPages, apPages + nPages, isBefore);
+  size_t nWord = 0;
+  for (j = 0; j < nPages; ++j)
+  {
+    anFirstWords[j] = nWord;
+    nWord += (apPages[j]->getBlockCount() + cnWordBits - 1) / cnWordBits;
+  }
+  std::fill(anBitmap, anBitmap + nWords, size_t(0));
+
+  size_t nBlockSize = pFirstPage->getBlockSize();
+  for (FreeBlock* b = pFirstPage->header_.getFirstBlock(); b; b = b->pNextBlock_)
+  {
+    j = std::upper_bound(apPages, apPages + nPages, (BasicPage*) b, isBefore) - apPages;
+    assert (j > 0);
+    BasicPage* p = apPages[--j];
+    assert ((char*) b >= (char*) p + p->header_.getFirstBlockOffset() && 
+            (char*) b < (char*) p + p->getByteSize());
+    size_t nBlock = ((char*) b - (char*) p - p->header_.getFirstBlockOffset()) / nBlockSize;
+    anBitmap[anFirstWords[j] + nBlock / cnWordBits] |= size_t(1) << (nBlock % cnWordBits);
+  }
+
+  FreeBlock* pFreeBlocks = nullptr;
+  FreeBlock** ppNext = &pFreeBlocks;
+  for (j = 0; j < nPages; ++j)
+  {
+    BasicPage* p = apPages[j];
+    char* pFirstBlock = (char*) p + p->header_.getFirstBlockOffset();
+    size_t nPageWords = (p->getBlockCount() + cnWordBits - 1) / cnWordBits;
+    for (size_t w = 0; w < nPageWords; ++w)
+      for (size_t nBits = anBitmap[anFirstWords[j] + w], k = 0; nBits; nBits >>= 1, ++k)
+        if (nBits & 1)
+        {
+          auto b = (FreeBlock*) (pFirstBlock + (w * cnWordBits + k) * nBlockSize);
+          *ppNext = b;
+          ppNext = &b->pNextBlock_;
+        }
+  }
+  *ppNext = nullptr;
+  pFirstPage->header_.setFirstBlock(pFreeBlocks);
+
+  theBackendAllocator->deallocateRaw(rawMemory);
+}
+
+template class BasicPage<SimplePageHeader>; // Page
+template class BasicPageList<Page>;
+template class BasicPageList<BitmapPage>;
+
 //========================================================================================
 // Unittests
 //________________________________________________________________________________________
@@ -289,84 +600,1643 @@ void test_Page()
   RG_EXPECT(Page::calcMinBlockCount(1) >= sizeof(Page) / cnMinAlign);
   RG_EXPECT(Page::calcMinBlockCount(sizeof(Page)) == 1)
 
-  size_t firstPageBlocks = Page::calcMinBlockCount(cnMinAlign);
-  RG_EXPECT(firstPageBlocks >= 1)
-  RG_EXPECT(Page::calcNewPageBlockCount(cnMinAlign, nullptr) == firstPageBlocks)
+  size_t firstPageShift = Page::calcFirstPageShift(cnMinAlign);
+  RG_EXPECT(firstPageShift == cnMinPageShift_)
+  RG_EXPECT(Page::calcFirstPageShift(cnMaxBlockSize_) > cnMinPageShift_)
+  RG_EXPECT(Page::calcNextPageShift(cnMaxPageShift_) == cnMaxPageShift_)
+  RG_EXPECT(Page::calcNextPageShift(cnMaxPageShift_, cnMaxHugePageShift_) == 
+            cnMaxPageShift_ + 1)
+  RG_EXPECT(Page::calcNextPageShift(10, 14, 3) == 13)
+  RG_EXPECT(Page::calcNextPageShift(12, 14, 3) == 14)
 
-  Page* p1 = Page::addNewPage(cnMinAlign, nullptr);
+  Page* p1 = Page::addNewPage(cnMinAlign, firstPageShift, nullptr);
   RG_EXPECT(p1 && p1->getBlockSize() == cnMinAlign);
-  size_t p2c = Page::calcNewPageBlockCount(cnMinAlign, p1);
-  RG_EXPECT(p2c == 2 * firstPageBlocks) 
-  Page* p2 = Page::addNewPage(cnMinAlign, p1);
-  size_t nFree = p2->countFreeBlocks();
-  RG_EXPECT(nFree >= firstPageBlocks + p2c);
-
-  void* b1 = p2->takeBlock();
-  RG_EXPECT(p2->countFreeBlocks() == nFree-1);
-  p2->returnBlock(b1);
-  RG_EXPECT(p2->countFreeBlocks() == nFree);
+  RG_EXPECT(p1->getPageShift() == firstPageShift && p1->getByteSize() == 64);
+  RG_EXPECT(Page::alignDown(p1, firstPageShift) == p1);
+  size_t p1c = p1->getBlockCount();
+  RG_EXPECT(p1c >= Page::calcMinBlockCount(cnMinAlign));
+  RG_EXPECT(p1->countUntouchedBlocks() == p1c && p1->countFreeBlocks() == p1c);
+
+  // Blocks are carved in address order, then recycled through the free list:
+  void* b1 = p1->takeBlock();
+  void* b2 = p1->takeBlock();
+  RG_EXPECT(b1 == p1 + 1 && (char*) b2 == (char*) b1 + cnMinAlign);
+  RG_EXPECT(p1->countUntouchedBlocks() == p1c - 2 && p1->countFreeBlocks() == p1c - 2);
+  p1->returnBlock(b1);
+  RG_EXPECT(p1->countFreeBlocks() == p1c - 1);
+  RG_EXPECT(p1->takeBlock() == b1);
+  std::vector<void*> blocks1 = {b1, b2};
+  while (p1->hasFreeBlocks())
+    blocks1.push_back(p1->takeBlock());
+  RG_EXPECT(blocks1.size() == p1c && p1->countFreeBlocks() == 0);
+
+  RG_EXPECT(Page::calcNextPageShift(firstPageShift) == firstPageShift + 1) 
+  Page* p2 = Page::addNewPage(cnMinAlign, firstPageShift + 1, p1);
+  size_t p2c = p2->getBlockCount();
+  RG_EXPECT(p2->getNextPage() == p1 && p2c > p1c);
+  RG_EXPECT(p2->countFreeBlocks() == p2c);
+  RG_EXPECT(Page::countPages(p2) == 2);
+
+  // Take all blocks of p2, and return all of p1, so that p1 is all free:
+  PageTable table;
+  table.addPage(p1);
+  table.addPage(p2);
+  std::vector<void*> blocks;
+  for (size_t j = 0; j < p2c; ++j)
+    blocks.push_back(p2->takeBlock());
+  RG_EXPECT(Page::alignDown(blocks.back(), p2->getPageShift()) == p2);
+  for (void* b : blocks1)
+    p2->returnBlock(b);
+  size_t nReclaimed = 0;
+  RG_EXPECT(Page::reclaimFreePages(p2, &table, &nReclaimed) == p2);
+  RG_EXPECT(nReclaimed == p1c && Page::countPages(p2) == 1);
+  RG_EXPECT(p2->getLiveBlockCount() == p2c && !p2->hasFreeBlocks());
+
+  p2->returnBlock(blocks[0]);
+  RG_EXPECT(Page::reclaimFreePages(p2, nullptr, &nReclaimed) == p2 && nReclaimed == 0);
+  RG_EXPECT(p2->getLiveBlockCount() == p2c - 1 && p2->countFreeBlocks() == 1);
+
+  for (size_t j = 1; j < p2c; ++j)
+    p2->returnBlock(blocks[j]);
+  RG_EXPECT(Page::reclaimFreePages(p2, nullptr, &nReclaimed) == nullptr);
+  RG_EXPECT(nReclaimed == p2c);
+
+  // Untouched blocks count as free too:
+  Page* p3 = Page::addNewPage(cnMinAlign, firstPageShift, nullptr);
+  p3->takeBlock();
+  RG_EXPECT(Page::reclaimFreePages(p3, nullptr, &nReclaimed) == p3);
+  RG_EXPECT(p3->getLiveBlockCount() == 1);
+  Page::deleteAllPages(p3);
+
+  // tryTakeBlock() fails once the free list and the untouched blocks are exhausted;
+  // the PackedPageHeader policy, on a (suitably aligned) local buffer:
+  typedef BasicPage<PackedPageHeader> PackedPage;
+  alignas(64) char buffer[64];
+  PackedPage* pp = (PackedPage*) buffer;
+  pp->initialize(cnMinAlign, firstPageShift, nullptr);
+  RG_EXPECT(pp->getBlockSize() == cnMinAlign && pp->getNextPage() == nullptr);
+  size_t ppc = 0;
+  void* b = nullptr;
+  while (void* next = pp->tryTakeBlock(cnMinAlign))
+    b = next, ++ppc;
+  RG_EXPECT(ppc == pp->getBlockCount() && ppc == PackedPage::calcBlockCount(cnMinAlign, firstPageShift));
+  RG_EXPECT(!pp->hasFreeBlocks() && pp->countFreeBlocks() == 0);
+  pp->returnBlock(b);
+  RG_EXPECT(pp->tryTakeBlock(cnMinAlign) == b && !pp->tryTakeBlock(cnMinAlign));
+
+  // Blocks are aligned to the largest power of 2 dividing their size:
+  for (size_t nBlockSize : {cnMinAlign, 3 * cnMinAlign, size_t(64), size_t(96), size_t(128)})
+  {
+    size_t nAlign = nBlockSize & (0 - nBlockSize),
+           nShift = Page::calcFirstPageShift(nBlockSize);
+    Page* p = Page::addNewPage(nBlockSize, nShift, nullptr);
+    bool bAligned = p->getBlockCount() >= Page::calcMinBlockCount(nBlockSize);
+    while (p->hasFreeBlocks())
+      bAligned = bAligned && (size_t(p->takeBlock()) & (nAlign - 1)) == 0;
+    RG_EXPECT(bAligned && p->getBlockCount() == Page::calcBlockCount(nBlockSize, nShift));
+    Page::deleteAllPages(p);
+  }
 
-  Page::deleteAllPages(p2);
+  // Page colors, by the address bits above the Page size; none for small Pages:
+  const void* pageAt3 = (void*) (size_t(3) << 12);
+  RG_EXPECT(Page::calcColorOffset(pageAt3, cnMinAlign, 12, 8) == 3 * cnCacheLineSize);
+  RG_EXPECT(Page::calcColorOffset(pageAt3, cnMinAlign, 12, 2) == cnCacheLineSize);
+  RG_EXPECT(Page::calcColorOffset(pageAt3, 128, 12, 4) == 3 * 128);
+  RG_EXPECT(Page::calcColorOffset(pageAt3, cnMinAlign, 12, 1) == 0);
+  RG_EXPECT(Page::calcColorOffset((void*) (size_t(3) << 11), cnMinAlign, 11, 8) == 0);
+  for (size_t nBlockSize : {size_t(24), size_t(128)})
+  {
+    Page* p = Page::addNewPage(nBlockSize, 12, nullptr, theBackendAllocator, 8);
+    size_t nOffset = Page::calcFirstBlockOffset(nBlockSize) + 
+                       Page::calcColorOffset(p, nBlockSize, 12, 8),
+           nCount = 0;
+    RG_EXPECT(p->getBlockCount() == (4096 - nOffset) / nBlockSize);
+    RG_EXPECT(p->takeBlock() == (char*) p + nOffset);
+    for (nCount = 1; p->hasFreeBlocks(); ++nCount)
+      p->takeBlock();
+    RG_EXPECT(nCount == p->getBlockCount());
+    Page::deleteAllPages(p);
+  }
 }
 
 RG_ADD_UNITTEST2(test_Page, 1);
 
 
 //////////////////////////////////////////////////////////////////////////////////////////
-/////////////////////////////////////// PageHandle ///////////////////////////////////////
+/////////////////////////////////////// BitmapPage ///////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//========================================================================================
+// Returns the block count, and sets '*pnFirstOffset': the header and the bitmap (a bit
+// per block), padded to the block alignment (see Page::calcFirstBlockOffset()).
+//________________________________________________________________________________________
+size_t BitmapPage::calcLayout(size_t nBlockSize, size_t nPageShift, size_t* pnFirstOffset)
+{
+  assert (nBlockSize > 0 && nBlockSize <= cnMaxBlockSize_ && 
+          nBlockSize == roundUp(nBlockSize, cnMinAlign));
+  size_t nByteSize = size_t(1) << nPageShift,
+         nAlign = nBlockSize & (0 - nBlockSize),
+         nRet = (nByteSize - sizeof(BitmapPage)) * 8 / (8 * nBlockSize + 1);
+  for (;; --nRet)
+  {
+    *pnFirstOffset = roundUp(sizeof(BitmapPage) + (nRet + 63) / 64 * 8, nAlign);
+    if (*pnFirstOffset + nRet * nBlockSize <= nByteSize || nRet == 0)
+      return nRet;
+  }
+}
+
+size_t BitmapPage::calcBlockCount(size_t nBlockSize, size_t nPageShift)
+{
+  size_t nFirstOffset = 0;
+  return calcLayout(nBlockSize, nPageShift, &nFirstOffset);
+}
+
+size_t BitmapPage::calcFirstBlockOffset(size_t nBlockSize, size_t nPageShift)
+{
+  size_t nFirstOffset = 0;
+  calcLayout(nBlockSize, nPageShift, &nFirstOffset);
+  return nFirstOffset;
+}
+
+//========================================================================================
+// As many blocks as Pages with a free list have in their smallest Page, at least.
+//________________________________________________________________________________________
+size_t BitmapPage::calcFirstPageShift(size_t nBlockSize)
+{
+  size_t nRet = cnMinPageShift_;
+  while (calcBlockCount(nBlockSize, nRet) < Page::calcMinBlockCount(nBlockSize))
+    ++nRet;
+  assert (nRet <= cnMaxPageShift_);
+  return nRet;
+}
+
+//========================================================================================
+// All blocks free: the bits of all blocks set, the bits past the last one clear.
+//________________________________________________________________________________________
+void BitmapPage::initialize(size_t      nBlockSize, 
+                            size_t      nPageShift, 
+                            BitmapPage* pagesSoFar, 
+                            size_t      /*nPageColors*/)
+{
+  size_t nFirstOffset = 0,
+         nBlockCount = calcLayout(nBlockSize, nPageShift, &nFirstOffset);
+  assert (nBlockCount > 0);
+  header_.pNextPage_ = pagesSoFar;
+  header_.pNextAvailPage_ = nullptr;
+  header_.nBlockSize_ = uint32_t(nBlockSize);
+  header_.nPageShift_ = uint16_t(nPageShift);
+  header_.nFirstBlockOffset_ = uint16_t(nFirstOffset);
+  header_.nBlockCount_ = uint32_t(nBlockCount);
+  header_.nLiveBlocks_ = 0;
+  header_.nFirstFreeWord_ = 0;
+  header_.nTouchedBlocks_ = 0;
+
+  uint64_t* bitmap = getBitmap();
+  std::fill(bitmap, bitmap + nBlockCount / 64, ~uint64_t(0));
+  if (nBlockCount % 64)
+    bitmap[nBlockCount / 64] = (uint64_t(1) << (nBlockCount % 64)) - 1;
+}
+
+//========================================================================================
+// Deletes the Pages without live blocks, by their exact counts: unlike with the free
+// lists, no blocks are walked. Otherwise as Page::reclaimFreePages().
+//________________________________________________________________________________________
+BitmapPage* BitmapPage::reclaimFreePages(BitmapPage*                 pFirstPage, 
+                                         BasicPageTable<BitmapPage>* pTable,
+                                         size_t*                     pnReclaimedBlocks,
+                                         const BackendAllocator*     backend)
+{
+  assert (pnReclaimedBlocks);
+  *pnReclaimedBlocks = 0;
+  BitmapPage *pRet = nullptr, 
+             *pLast = nullptr;
+  for (BitmapPage* p = pFirstPage; p; /**/)
+  {
+    BitmapPage* next = p->getNextPage();
+    if (p->getLiveBlockCount() == 0)
+    {
+      *pnReclaimedBlocks += p->getBlockCount();
+      if (pTable)
+        pTable->removePage(p);
+      statsRemoveBackendPage(p->getByteSize());
+      backend->deallocateAlignedRaw(p, p->getByteSize());
+    }
+    else 
+    {
+      if (pLast)
+        pLast->header_.pNextPage_ = p;
+      else
+        pRet = p;
+      pLast = p;
+    }
+    p = next;
+  }
+  if (pLast)
+    pLast->header_.pNextPage_ = nullptr;
+  return pRet;
+}
+
+//========================================================================================
+// Unittests
+//________________________________________________________________________________________
+void test_BitmapPage()
+{
+  // The scan finds the word, whatever its alignment and position in a vector:
+  alignas(64) uint64_t words[40] = {};
+  RG_EXPECT(findNonZeroWord(words, 0, 40) == 40 && findNonZeroWord(words, 3, 3) == 3);
+  bool bFound = true;
+  for (size_t j = 0; j < 40; ++j)
+  {
+    words[j] = uint64_t(1) << (j * 7 % 64);
+    for (size_t nBegin = 0; nBegin <= j; ++nBegin)
+      bFound = bFound && findNonZeroWord(words, nBegin, 40) == j &&
+                         findNonZeroWord(words, nBegin, j) == j;
+    bFound = bFound && findFirstSetBit(words[j]) == j * 7 % 64;
+    words[j] = 0;
+  }
+  RG_EXPECT(bFound);
+
+  for (size_t nBlockSize : {cnMinAlign, 3 * cnMinAlign, cnMaxBlockSize_})
+  {
+    size_t nShift = BitmapPage::calcFirstPageShift(nBlockSize);
+    RG_EXPECT(BitmapPage::calcBlockCount(nBlockSize, nShift) >= 
+                Page::calcMinBlockCount(nBlockSize));
+    RG_EXPECT(BitmapPage::calcFirstBlockOffset(nBlockSize, cnMaxPageShift_) == 
+                roundUp(sizeof(BitmapPage) + 
+                          (BitmapPage::calcBlockCount(nBlockSize, cnMaxPageShift_) + 63) / 
+                            64 * 8, 
+                        nBlockSize & (0 - nBlockSize)));
+  }
+
+  // The lowest free block goes out first; the counts are exact:
+  BitmapPage* p1 = BitmapPage::addNewPage(3 * cnMinAlign, 12, nullptr);
+  size_t nCount = p1->getBlockCount();
+  RG_EXPECT(nCount == BitmapPage::calcBlockCount(3 * cnMinAlign, 12) && nCount > 128);
+  std::vector<void*> blocks;
+  while (void* b = p1->tryTakeBlock(3 * cnMinAlign))
+    blocks.push_back(b);
+  RG_EXPECT(blocks.size() == nCount && p1->getLiveBlockCount() == nCount);
+  RG_EXPECT(std::is_sorted(blocks.begin(), blocks.end(), std::less<void*>()));
+  RG_EXPECT((char*) blocks.back() + 3 * cnMinAlign <= (char*) p1 + p1->getByteSize());
+  RG_EXPECT(!p1->hasFreeBlocks() && !p1->takeBlock());
+
+  for (size_t j = 0; j < nCount; j += 2)
+    p1->returnBlock(blocks[j]);
+  RG_EXPECT(p1->countFreeBlocks() == (nCount + 1) / 2);
+  RG_EXPECT(!p1->isLiveBlock(blocks[0]) && p1->isLiveBlock(blocks[1]));
+  size_t nLive = 0;
+  bool bOdd = true;
+  p1->forEachLiveBlock([&](void* b) 
+  { 
+    bOdd = bOdd && b == blocks[2 * nLive + 1];
+    ++nLive;
+  });
+  RG_EXPECT(nLive == nCount / 2 && bOdd);
+  p1->returnBlock(blocks[nCount - 1 - nCount % 2]); // The last live one
+  RG_EXPECT(p1->takeBlock() == blocks[0] && p1->takeBlock() == blocks[2]);
+
+  // Only the Pages without live blocks are reclaimed:
+  BitmapPage* p2 = BitmapPage::addNewPage(3 * cnMinAlign, 12, p1);
+  RG_EXPECT(p2->getNextPage() == p1 && BitmapPage::countPages(p2) == 2);
+  void* b2 = p2->takeBlock();
+  size_t nReclaimed = 0;
+  RG_EXPECT(BitmapPage::reclaimFreePages(p2, nullptr, &nReclaimed) == p2 && 
+            nReclaimed == 0);
+  p2->returnBlock(b2);
+  size_t nCount2 = p2->getBlockCount();
+  RG_EXPECT(BitmapPage::reclaimFreePages(p2, nullptr, &nReclaimed) == p1 && 
+            nReclaimed == nCount2);
+  RG_EXPECT(p1->getNextPage() == nullptr && BitmapPage::countPages(p1) == 1);
+  BitmapPage::deleteAllPages(p1);
+}
+
+RG_ADD_UNITTEST2(test_BitmapPage, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PageCache ////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 
+thread_local bool PageCache::bDestroyed_ = false;
+std::atomic<size_t> PageCache::nCapacity_(PageCache::cnDefaultCapacity);
+
+//========================================================================================
+//________________________________________________________________________________________
+PageCache::~PageCache()
+{
+  releaseAll();
+}
+
 //========================================================================================
+// Any cached Page of that size and backend; usually the first one.
 //________________________________________________________________________________________
-PageHandle* PageHandle::findPrevInList()
+void* PageCache::takePage(size_t nPageShift, const BackendAllocator* backend)
 {
-  assert(pNext_ != this);
+  assert (nPageShift <= cnMaxHugePageShift_);
+  for (CachedPage** ppNext = &apPages_[nPageShift]; CachedPage* p = *ppNext; 
+       ppNext = &p->pNext_)
+    if (p->pBackend_ == backend)
+    {
+      *ppNext = p->pNext_;
+      nBytes_ -= size_t(1) << nPageShift;
+      return p;
+    }
+  return nullptr;
+}
 
-  for (auto h = pNext_; /**/; h = h->pNext_)
-    if (h->pNext_ == this)
-      return h;
+//========================================================================================
+// Returns false (keeping nothing) if the Page would exceed the capacity.
+//________________________________________________________________________________________
+bool PageCache::returnPage(void* page, size_t nPageShift, const BackendAllocator* backend)
+{
+  assert (nPageShift <= cnMaxHugePageShift_);
+  size_t nByteSize = size_t(1) << nPageShift;
+  if (nBytes_ + nByteSize > getCapacity())
+    return false;
+  CachedPage* p = (CachedPage*) page;
+  p->pNext_ = apPages_[nPageShift];
+  p->pBackend_ = backend;
+  apPages_[nPageShift] = p;
+  nBytes_ += nByteSize;
+  return true;
 }
 
 //========================================================================================
 //________________________________________________________________________________________
-bool PageHandle::inSameList(const PageHandle* ph) const
+void PageCache::releaseAll()
 {
-  if (this == ph)
-    return true;
-  for (auto h = pNext_; h != this; h = h->pNext_)
-    if (h == ph)
-      return true;
-  return false;
+  for (size_t j = 0; j <= cnMaxHugePageShift_; ++j)
+    while (CachedPage* p = apPages_[j])
+    {
+      apPages_[j] = p->pNext_;
+      statsRemoveBackendPage(size_t(1) << j);
+      p->pBackend_->deallocateAlignedRaw(p, size_t(1) << j);
+    }
+  nBytes_ = 0;
 }
 
 //========================================================================================
-// PaHandle unittests
 //________________________________________________________________________________________
-void test_PaHandle()
+void* PageCache::allocatePage(size_t nPageShift, const BackendAllocator* backend)
 {
-  PageHandle n1, n2;
-  RG_EXPECT(n1.isSingleInList() && n2.isSingleInList());
+  if (PageCache* cache = get())
+    if (void* ret = cache->takePage(nPageShift, backend))
+      return ret;
+  size_t nByteSize = size_t(1) << nPageShift;
+  void* ret = backend->allocateAlignedRaw(nByteSize, nByteSize);
+  statsAddBackendPage(nByteSize);
+  return ret;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void PageCache::deallocatePage(void*                   page, 
+                               size_t                  nPageShift, 
+                               const BackendAllocator* backend)
+{
+  PageCache* cache = get();
+  if (!cache || !cache->returnPage(page, nPageShift, backend))
+  {
+    statsRemoveBackendPage(size_t(1) << nPageShift);
+    backend->deallocateAlignedRaw(page, size_t(1) << nPageShift);
+  }
+}
+
+//========================================================================================
+// PageCache unittests
+//________________________________________________________________________________________
+void test_PageCache()
+{
+  PageCache cache;
+  const BackendAllocator* mb = &BackendAdapter<MallocBackend>::instance;
+  const size_t nShift = 12, nSize = size_t(1) << nShift;
+  void* p1 = theBackendAllocator->allocateAlignedRaw(nSize, nSize);
+  void* p2 = mb->allocateAlignedRaw(nSize, nSize);
+
+  // Pages are handed out by size and backend:
+  RG_EXPECT(!cache.takePage(nShift, theBackendAllocator));
+  RG_EXPECT(cache.returnPage(p1, nShift, theBackendAllocator));
+  RG_EXPECT(cache.returnPage(p2, nShift, mb));
+  RG_EXPECT(cache.getByteSize() == 2 * nSize);
+  RG_EXPECT(!cache.takePage(nShift + 1, theBackendAllocator));
+  RG_EXPECT(cache.takePage(nShift, theBackendAllocator) == p1);
+  RG_EXPECT(!cache.takePage(nShift, theBackendAllocator));
+
+  // ... up to the capacity:
+  size_t nCapacity = PageCache::getCapacity();
+  PageCache::setCapacity(nSize);
+  RG_EXPECT(!cache.returnPage(p1, nShift, theBackendAllocator));
+  PageCache::setCapacity(nCapacity);
+  RG_EXPECT(cache.returnPage(p1, nShift, theBackendAllocator));
+  cache.releaseAll();
+  RG_EXPECT(cache.getByteSize() == 0 && !cache.takePage(nShift, mb));
+
+  // A deleted chain's Pages serve the next one:
+  PageChain chain;
+  chain.nBlockSize_ = cnMinAlign;
+  void* b = chain.takeBlock();
+  Page* pPage = chain.pPage_;
+  chain.returnBlock(b);
+  chain.deleteAllPages();
+  chain.takeBlock();
+  RG_EXPECT(chain.pPage_ == pPage);
+  chain.deleteAllPages();
+}
+
+RG_ADD_UNITTEST2(test_PageCache, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PageTable ////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//========================================================================================
+// Max-size Pages need no entry.
+//________________________________________________________________________________________
+template <typename PageT>
+void BasicPageTable<PageT>::addPage(PageT* page)
+{
+  size_t nShift = page->getPageShift();
+  if (nShift == nMaxPageShift_)
+    return;
+  assert (nShift >= cnMinPageShift_ && nShift < nMaxPageShift_);
+  assert (!apSmallPages_[nShift - cnMinPageShift_]); // Page sizes should only grow
+  apSmallPages_[nShift - cnMinPageShift_] = page;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename PageT>
+void BasicPageTable<PageT>::removePage(PageT* page)
+{
+  size_t nShift = page->getPageShift();
+  if (nShift == nMaxPageShift_)
+    return;
+  assert (apSmallPages_[nShift - cnMinPageShift_] == page);
+  apSmallPages_[nShift - cnMinPageShift_] = nullptr;
+}
+
+template class BasicPageTable<Page>;
+template class BasicPageTable<BitmapPage>;
+
+//========================================================================================
+// PageTable unittests
+//________________________________________________________________________________________
+void test_PageTable()
+{
+  // Pages of all sizes, from the smallest to two of the largest, with all blocks taken:
+  Page* pages = nullptr;
+  PageTable table;
+  std::vector<void*> blocks;
+  for (size_t j = Page::calcFirstPageShift(cnMaxBlockSize_); j <= cnMaxPageShift_ + 1; ++j)
+  {
+    pages = Page::addNewPage(cnMaxBlockSize_, std::min(j, cnMaxPageShift_), pages);
+    table.addPage(pages);
+    while (pages->hasFreeBlocks())
+      blocks.push_back(pages->takeBlock());
+  }
+  RG_EXPECT(pages->getPageShift() == cnMaxPageShift_ && 
+            pages->getNextPage()->getPageShift() == cnMaxPageShift_);
+
+  size_t nFound = 0;
+  for (void* b : blocks)
+  {
+    Page* p = table.findPage(b);
+    nFound += (char*) b > (char*) p && (char*) b < (char*) p + p->getByteSize();
+  }
+  RG_EXPECT(!blocks.empty() && nFound == blocks.size());
 
-  n1.addSelfToList(&n2);
-  RG_EXPECT(n1.pNext_ == &n2 && n2.pNext_ == &n1);
-  RG_EXPECT(!n1.pPage_ && !n2.pPage_);
+  Page* last = pages;
+  while (last->getNextPage())
+    last = last->getNextPage();
+  table.removePage(last);
+  RG_EXPECT(table.findPage((char*) last + sizeof(Page)) != last ||
+            Page::alignDown(last, cnMaxPageShift_) == last); // Found by chance
 
-  n2.removeSelfFromList();
-  RG_EXPECT(n1.isSingleInList() && n2.isSingleInList());
+  Page::deleteAllPages(pages);
+}
+
+RG_ADD_UNITTEST2(test_PageTable, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////// ChainSizeHistory ////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+std::atomic<uint32_t> ChainSizeHistory::anAverages_[cnEntryCount];
+
+//========================================================================================
+// Sizes are recorded as the ceiling of their log2; the first one as is.
+//________________________________________________________________________________________
+void ChainSizeHistory::record(size_t nBlockSize, size_t nBlocks)
+{
+  if (nBlocks == 0)
+    return;
+  uint32_t nLog2 = 0;
+  while ((size_t(1) << nLog2) < nBlocks)
+    ++nLog2;
+  int32_t nValue = int32_t((nLog2 + 1) * cnScale);
+
+  std::atomic<uint32_t>& average = getAverage(nBlockSize);
+  int32_t nAverage = int32_t(average.load(std::memory_order_relaxed));
+  nAverage = nAverage ? nAverage + (nValue - nAverage) / 8 : nValue;
+  average.store(uint32_t(nAverage), std::memory_order_relaxed);
+}
+
+//========================================================================================
+// The average log2, rounded to the nearest.
+//________________________________________________________________________________________
+size_t ChainSizeHistory::getTypicalBlockCount(size_t nBlockSize)
+{
+  uint32_t nAverage = getAverage(nBlockSize).load(std::memory_order_relaxed);
+  if (nAverage == 0)
+    return 0;
+  return size_t(1) << ((nAverage - cnScale + cnScale / 2) / cnScale);
+}
+
+void ChainSizeHistory::clear(size_t nBlockSize)
+{
+  getAverage(nBlockSize).store(0, std::memory_order_relaxed);
+}
+
+//========================================================================================
+// Unittests
+//________________________________________________________________________________________
+void test_ChainSizeHistory()
+{
+  const size_t nBlockSize = cnMaxBlockSize_ - cnMinAlign; // Used by no other test
+  ChainSizeHistory::clear(nBlockSize);
+  RG_EXPECT(ChainSizeHistory::getTypicalBlockCount(nBlockSize) == 0);
+  ChainSizeHistory::record(nBlockSize, 0);
+  RG_EXPECT(ChainSizeHistory::getTypicalBlockCount(nBlockSize) == 0);
+  ChainSizeHistory::record(nBlockSize, 1000);
+  RG_EXPECT(ChainSizeHistory::getTypicalBlockCount(nBlockSize) == 1024);
+
+  // An outlier (1000 times larger) moves it by a doubling at most; a lasting change
+  // does more:
+  ChainSizeHistory::record(nBlockSize, 1000 * 1000);
+  RG_EXPECT(ChainSizeHistory::getTypicalBlockCount(nBlockSize) <= 2048);
+  for (int j = 0; j < 30; ++j)
+    ChainSizeHistory::record(nBlockSize, 30);
+  RG_EXPECT(ChainSizeHistory::getTypicalBlockCount(nBlockSize) == 32);
+
+  // Adaptive chains record their size, and start with a Page fitting it:
+  PageChain chain;
+  chain.nBlockSize_ = nBlockSize;
+  PageGrowth growth;
+  growth.bAdaptiveFirstPage = true;
+  chain.setGrowth(growth);
+  for (int j = 0; j < 8; ++j)
+  {
+    for (int k = 0; k < 500; ++k)
+      chain.takeBlock();
+    chain.deleteAllPages();
+  }
+  size_t nTypical = ChainSizeHistory::getTypicalBlockCount(nBlockSize);
+  RG_EXPECT(nTypical >= 256 && nTypical <= 512);
+  chain.addNewPage();
+  RG_EXPECT(chain.pPage_->getBlockCount() >= nTypical && 
+            Page::calcBlockCount(nBlockSize, chain.nPageShift_ - 1) < nTypical);
+  chain.deleteAllPages();
+
+  // Not for the other chains:
+  PageChain other;
+  other.nBlockSize_ = nBlockSize;
+  other.setGrowth(PageGrowth());
+  other.takeBlock();
+  RG_EXPECT(other.nPageShift_ == Page::calcFirstPageShift(nBlockSize));
+  other.deleteAllPages();
+  ChainSizeHistory::clear(nBlockSize);
+}
 
-  n1.addSelfToList(&n2);
-  auto pa = n1.getOrCreatePage(20, true);
+RG_ADD_UNITTEST2(test_ChainSizeHistory, 1);
 
-  RG_EXPECT(pa && pa->getBlockSize() >= 20);
-  RG_EXPECT(pa && pa->countFreeBlocks() >= 1);
-  RG_EXPECT (n1.pPage_ == pa && n2.pPage_ == pa);
 
-  n2.removeSelfFromList();
-  RG_EXPECT(n2.isSingleInList() && !n2.pPage_ && n1.pPage_);
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PageChain ////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
 
-  n2.addSelfToList(&n1);
-  RG_EXPECT(n2.pPage_ == pa);
-  Page::deleteAllPages(pa);
+//========================================================================================
+// Return the fully-free Pages to the backend. The next automatic trim() is due once 
+// the free blocks grow by another nTrimThreshold_ bytes.
+//________________________________________________________________________________________
+template <typename PageT>
+void BasicPageChain<PageT>::trim()
+{
+  #if RG_PRIVATEALLOCATOR_STATS
+    size_t nPages = 0, nBytes = 0;
+    for (PageT* p = pPage_; p; p = p->getNextPage())
+      ++nPages, nBytes += p->getByteSize();
+  #endif
+
+  size_t nReclaimed = 0;
+  pPage_ = PageT::reclaimFreePages(pPage_, pPageTable_, &nReclaimed, pBackend_);
+
+  #if RG_PRIVATEALLOCATOR_STATS
+    for (PageT* p = pPage_; p; p = p->getNextPage())
+      --nPages, nBytes -= p->getByteSize();
+    if (pStats_)
+      pStats_->removePages(nPages, nBytes);
+  #endif
+
+  assert (nReclaimed <= nBlockCount_ - nLiveBlocks_);
+  nBlockCount_ -= nReclaimed;
+  if (!pPage_)
+    nPageShift_ = 0; // Start over with a small Page
+  setTrimThreshold(nTrimThreshold_);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename PageT>
+void BasicPageChain<PageT>::addNewPage(size_t nMinBlockCount)
+{
+  linkPage(createPage(nMinBlockCount));
+}
+
+//========================================================================================
+// The Page is of the next size, or larger (up to the maximum) for 'nMinBlockCount' - 
+// or, for the first Page of an adaptive chain, for the typical size.
+//________________________________________________________________________________________
+template <typename PageT>
+PageT* BasicPageChain<PageT>::createPage(size_t nMinBlockCount)
+{
+  if (nPageShift_)
+    nPageShift_ = Page::calcNextPageShift(nPageShift_, nMaxPageShift_, nGrowthShift_);
+  else 
+  {
+    nPageShift_ = nFirstPageShift_ ? nFirstPageShift_ 
+                                   : PageT::calcFirstPageShift(nBlockSize_);
+    if (bAdaptiveFirstPage_)
+      nMinBlockCount = std::max(nMinBlockCount, 
+                                ChainSizeHistory::getTypicalBlockCount(nBlockSize_));
+  }
+  while (nPageShift_ < nMaxPageShift_ && 
+         PageT::calcBlockCount(nBlockSize_, nPageShift_) < nMinBlockCount)
+    ++nPageShift_;
+  PageT* ret = PageT::addNewPage(nBlockSize_, nPageShift_, nullptr, pBackend_, nPageColors_);
+  nBlockCount_ += ret->getBlockCount();
+  if (pStats_)
+    pStats_->addPage(ret->getByteSize());
+  return ret;
+}
+
+//========================================================================================
+// In front of the others; the PageTable is created along with the 2nd Page.
+//________________________________________________________________________________________
+template <typename PageT>
+void BasicPageChain<PageT>::linkPage(PageT* page)
+{
+  assert (page && page->getBlockSize() == nBlockSize_);
+  PageT* pPrev = pPage_;
+  page->setNextPage(pPrev);
+  pPage_ = page;
+
+  if (pPrev && !pPageTable_)
+  {
+    void* rawMemory = theBackendAllocator->allocateRaw(sizeof(BasicPageTable<PageT>));
+    pPageTable_ = new (rawMemory) BasicPageTable<PageT>(nMaxPageShift_);
+    assert (!pPrev->getNextPage());
+    pPageTable_->addPage(pPrev);
+  }
+  if (pPageTable_)
+    pPageTable_->addPage(pPage_);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename PageT>
+void BasicPageChain<PageT>::deleteAllPages()
+{
+  if (bAdaptiveFirstPage_ && pPage_)
+    ChainSizeHistory::record(nBlockSize_, nBlockCount_ - pPage_->countUntouchedBlocks());
+  #if RG_PRIVATEALLOCATOR_STATS
+    if (pStats_)
+      for (PageT* p = pPage_; p; p = p->getNextPage())
+        pStats_->removePages(1, p->getByteSize());
+  #endif
+  PageT::deleteAllPages(pPage_, pBackend_);
+  pPage_ = nullptr;
+  nBlockCount_ = nLiveBlocks_ = nPageShift_ = 0;
+  if (pPageTable_)
+  {
+    pPageTable_->~BasicPageTable();
+    theBackendAllocator->deallocateRaw(pPageTable_);
+    pPageTable_ = nullptr;
+  }
+}
+
+//========================================================================================
+// Resolves the defaults, and makes sure that the Pages fit at least one block.
+//________________________________________________________________________________________
+template <typename PageT>
+void BasicPageChain<PageT>::setGrowth(const PageGrowth& growth)
+{
+  assert (nBlockSize_ > 0 && !pPage_ && growth.nGrowthShift > 0);
+  assert (growth.nPageColors > 0 && growth.nPageColors <= cnMaxPageColors_ &&
+          (growth.nPageColors & (growth.nPageColors - 1)) == 0);
+  size_t nMinShift = PageT::calcFirstPageShift(nBlockSize_);
+  nMaxPageShift_ = growth.nMaxPageShift ? growth.nMaxPageShift 
+                                        : pBackend_->getMaxPageShift();
+  nMaxPageShift_ = std::min(std::max(nMaxPageShift_, nMinShift), cnMaxHugePageShift_);
+  nFirstPageShift_ = growth.nFirstPageShift 
+                       ? std::min(std::max(growth.nFirstPageShift, nMinShift), 
+                                  nMaxPageShift_)
+                       : 0;
+  nGrowthShift_ = growth.nGrowthShift;
+  nPageColors_ = growth.nPageColors;
+  bAdaptiveFirstPage_ = growth.bAdaptiveFirstPage;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename PageT>
+void BasicPageChain<PageT>::setTrimThreshold(size_t nFreeBytes)
+{
+  assert (nBlockSize_ > 0);
+  nTrimThreshold_ = nFreeBytes;
+  nTrimAt_ = nBlockCount_ - nLiveBlocks_ + std::max<size_t>(nFreeBytes / nBlockSize_, 1);
+}
+
+template <typename PageT>
+void BasicPageChain<PageT>::setSortThreshold(size_t nReturns)
+{
+  nSortThreshold_ = nReturnsToSort_ = nReturns;
+}
+
+template struct BasicPageChain<Page>;
+template struct BasicPageChain<BitmapPage>;
+
+//========================================================================================
+// The Pages beyond the one serving now are kept aside, untouched (see PageChain).
+//________________________________________________________________________________________
+void PageChain::reserve(size_t nFreeBlocks)
+{
+  while (nBlockCount_ - nLiveBlocks_ < nFreeBlocks)
+  {
+    size_t nMissing = nFreeBlocks - (nBlockCount_ - nLiveBlocks_);
+    if (!hasFreeBlocks() && !pReservedPages_)
+      BasicPageChain<Page>::addNewPage(nMissing);
+    else
+    {
+      Page* p = createPage(nMissing);
+      p->setNextPage(pReservedPages_);
+      pReservedPages_ = p;
+    }
+  }
+  if (nTrimThreshold_)
+    setTrimThreshold(nTrimThreshold_); // Not to trim the reserve right away
+}
+
+//========================================================================================
+// The first Page has no free blocks: a reserved Page takes its place, if any.
+//________________________________________________________________________________________
+void PageChain::addNewPage()
+{
+  if (Page* p = pReservedPages_)
+  {
+    pReservedPages_ = p->getNextPage();
+    linkPage(p);
+  }
+  else
+    BasicPageChain<Page>::addNewPage();
+}
+
+//========================================================================================
+// The reserved Pages are all free, so trim() releases them too.
+//________________________________________________________________________________________
+void PageChain::trim()
+{
+  deleteReservedPages(true);
+  BasicPageChain<Page>::trim();
+}
+
+void PageChain::deleteAllPages()
+{
+  deleteReservedPages(false);
+  BasicPageChain<Page>::deleteAllPages();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void PageChain::deleteReservedPages(bool bTrim)
+{
+  while (Page* p = pReservedPages_)
+  {
+    pReservedPages_ = p->getNextPage();
+    nBlockCount_ -= p->getBlockCount();
+    if (pStats_)
+      pStats_->removePages(1, p->getByteSize());
+    if (bTrim)
+    {
+      statsRemoveBackendPage(p->getByteSize());
+      pBackend_->deallocateAlignedRaw(p, p->getByteSize());
+    }
+    else
+      PageCache::deallocatePage(p, p->getPageShift(), pBackend_);
+  }
+}
+
+//========================================================================================
+// The next automatic sort is due after another nSortThreshold_ returned blocks.
+//________________________________________________________________________________________
+void PageChain::sortFreeBlocks()
+{
+  Page::sortFreeBlocks(pPage_);
+  nReturnsToSort_ = nSortThreshold_;
+}
+
+//========================================================================================
+// PageChain unittests
+//________________________________________________________________________________________
+void test_PageChain()
+{
+  PageChain chain;
+  chain.nBlockSize_ = cnMinAlign;
+
+  std::vector<void*> blocks;
+  for (int j = 0; j < 1000; ++j)
+    blocks.push_back(chain.takeBlock());
+  size_t nPages = Page::countPages(chain.pPage_);
+  RG_EXPECT(chain.nLiveBlocks_ == 1000 && chain.nBlockCount_ >= 1000 && nPages > 2);
+  size_t nFound = 0;
+  for (void* b : blocks)
+  {
+    Page* p = chain.findPage(b);
+    nFound += (char*) b > (char*) p && (char*) b < (char*) p + p->getByteSize();
+  }
+  RG_EXPECT(nFound == blocks.size());
+  RG_EXPECT(chain.nPageShift_ == chain.pPage_->getPageShift());
+
+  // Free the oldest blocks; their Pages get reclaimed:
+  for (int j = 0; j < 500; ++j)
+    chain.returnBlock(blocks[j]);
+  chain.trim();
+  RG_EXPECT(chain.nLiveBlocks_ == 500 && Page::countPages(chain.pPage_) < nPages);
+  RG_EXPECT(chain.pPage_->countFreeBlocks() == chain.nBlockCount_ - 500);
+  for (int j = 0; j < 500; ++j)
+    blocks[j] = chain.takeBlock();
+
+  // Automatic trim() upon freeing enough blocks:
+  size_t nBlockCount = chain.nBlockCount_;
+  chain.setTrimThreshold(100 * cnMinAlign);
+  for (int j = 0; j < 1000; ++j)
+    chain.returnBlock(blocks[j]);
+  RG_EXPECT(chain.nLiveBlocks_ == 0 && chain.nBlockCount_ < nBlockCount);
+  chain.trim();
+  RG_EXPECT(!chain.pPage_ && chain.nBlockCount_ == 0);
+  RG_EXPECT(chain.takeBlock() && chain.nBlockCount_ > 0);
+  RG_EXPECT(chain.nPageShift_ == Page::calcFirstPageShift(cnMinAlign));
+  chain.deleteAllPages();
+
+  // Blocks returned out of order go out in address order after sortFreeBlocks(); 
+  // automatically, once per that many returned blocks:
+  PageChain sorted;
+  sorted.nBlockSize_ = 3 * cnMinAlign;
+  for (size_t nThreshold : {size_t(0), size_t(1000)})
+  {
+    sorted.setSortThreshold(nThreshold);
+    blocks.clear();
+    for (int j = 0; j < 1000; ++j)
+      blocks.push_back(sorted.takeBlock());
+    for (int j = 0; j < 1000; ++j)
+      sorted.returnBlock(blocks[j * 7 % 1000]);
+    if (!nThreshold)
+      sorted.sortFreeBlocks();
+    std::vector<void*> taken;
+    for (int j = 0; j < 1000; ++j)
+      taken.push_back(sorted.takeBlock());
+    RG_EXPECT(std::is_sorted(taken.begin(), taken.end(), std::less<void*>()));
+    std::sort(blocks.begin(), blocks.end(), std::less<void*>());
+    RG_EXPECT(taken == blocks && Page::countPages(sorted.pPage_) > 2);
+    for (void* b : taken)
+      sorted.returnBlock(b);
+  }
+  sorted.deleteAllPages();
+
+  // Custom growth: 1 KiB, 4 KiB, 16 KiB, 16 KiB...
+  PageChain grown;
+  grown.nBlockSize_ = cnMinAlign;
+  PageGrowth growth;
+  growth.nFirstPageShift = 10;
+  growth.nGrowthShift = 2;
+  growth.nMaxPageShift = 14;
+  grown.setGrowth(growth);
+  std::vector<size_t> shifts;
+  for (int j = 0; j < 10000; ++j)
+  {
+    grown.takeBlock();
+    if (shifts.empty() || shifts.back() != grown.nPageShift_)
+      shifts.push_back(grown.nPageShift_);
+  }
+  RG_EXPECT(shifts == std::vector<size_t>({10, 12, 14}));
+
+  // reserve() adds as few Pages as possible; no more are needed for that many blocks.
+  // The Pages are left untouched, the serving one included:
+  size_t nPagesBefore = Page::countPages(grown.pPage_),
+         nUntouched = grown.pPage_->countUntouchedBlocks();
+  grown.reserve(20000);
+  RG_EXPECT(grown.nBlockCount_ - grown.nLiveBlocks_ >= 20000);
+  RG_EXPECT(Page::countPages(grown.pPage_) == nPagesBefore && 
+            grown.pPage_->countUntouchedBlocks() == nUntouched);
+  size_t nReserved = 0;
+  bool bUntouched = true;
+  for (Page* p = grown.pReservedPages_; p; p = p->getNextPage())
+    ++nReserved, bUntouched = bUntouched && p->countUntouchedBlocks() == p->getBlockCount();
+  RG_EXPECT(nReserved <= 20000 * cnMinAlign / 16384 + 1 && bUntouched);
+  nBlockCount = grown.nBlockCount_;
+  blocks.clear();
+  for (int j = 0; j < 20000; ++j)
+    blocks.push_back(grown.takeBlock());
+  RG_EXPECT(grown.nBlockCount_ == nBlockCount && !grown.pReservedPages_);
+  std::sort(blocks.begin(), blocks.end());
+  RG_EXPECT(std::unique(blocks.begin(), blocks.end()) == blocks.end());
+  nFound = 0;
+  for (void* b : blocks)
+  {
+    Page* p = grown.findPage(b);
+    nFound += (char*) b > (char*) p && (char*) b < (char*) p + p->getByteSize();
+  }
+  RG_EXPECT(nFound == blocks.size());
+
+  // The reserved Pages are all free: trim() releases them, with the others:
+  for (void* b : blocks)
+    grown.returnBlock(b);
+  grown.reserve(grown.nBlockCount_ - grown.nLiveBlocks_ + 20000);
+  RG_EXPECT(grown.pReservedPages_);
+  grown.trim();
+  size_t nLinkedBlocks = 0;
+  for (Page* p = grown.pPage_; p; p = p->getNextPage())
+    nLinkedBlocks += p->getBlockCount();
+  RG_EXPECT(!grown.pReservedPages_ && grown.nBlockCount_ == nLinkedBlocks);
+  grown.deleteAllPages();
+
+  // A backend allowing huge Pages; two Pages of the largest size:
+  PageChain huge;
+  huge.nBlockSize_ = cnMaxBlockSize_;
+  huge.pBackend_ = &BackendAdapter<MmapBackend>::instance;
+  huge.setGrowth(PageGrowth());
+  blocks.clear();
+  while (huge.nPageShift_ < MmapBackend::cnMaxPageShift || 
+         huge.pPage_->getNextPage()->getPageShift() < MmapBackend::cnMaxPageShift)
+    blocks.push_back(huge.takeBlock());
+  RG_EXPECT(huge.pPage_->getByteSize() == size_t(1) << MmapBackend::cnMaxPageShift);
+  nFound = 0;
+  for (void* b : blocks)
+  {
+    Page* p = huge.findPage(b);
+    nFound += (char*) b > (char*) p && (char*) b < (char*) p + p->getByteSize();
+  }
+  RG_EXPECT(nFound == blocks.size());
+  huge.deleteAllPages();
+}
+
+RG_ADD_UNITTEST2(test_PageChain, 1);
+
+//========================================================================================
+// A new Page only when no Page has a free block; it is the first to serve them.
+//________________________________________________________________________________________
+void BitmapPageChain::addAvailPage()
+{
+  assert (!pAvailPage_);
+  addNewPage();
+  pAvailPage_ = pPage_;
+}
+
+//========================================================================================
+// After the Pages changed (e.g. some were reclaimed): the older Pages serve first.
+//________________________________________________________________________________________
+void BitmapPageChain::relinkAvailPages()
+{
+  pAvailPage_ = nullptr;
+  for (BitmapPage* p = pPage_; p; p = p->getNextPage())
+    if (p->hasFreeBlocks())
+    {
+      p->setNextAvailPage(pAvailPage_);
+      pAvailPage_ = p;
+    }
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void BitmapPageChain::trim()
+{
+  BasicPageChain<BitmapPage>::trim();
+  relinkAvailPages();
+}
+
+void BitmapPageChain::deleteAllPages()
+{
+  BasicPageChain<BitmapPage>::deleteAllPages();
+  pAvailPage_ = nullptr;
+}
+
+//========================================================================================
+// The new Pages are all free, so they are simply added to the available ones.
+//________________________________________________________________________________________
+void BitmapPageChain::reserve(size_t nFreeBlocks)
+{
+  while (nBlockCount_ - nLiveBlocks_ < nFreeBlocks)
+  {
+    addNewPage(nFreeBlocks - (nBlockCount_ - nLiveBlocks_));
+    pPage_->setNextAvailPage(pAvailPage_);
+    pAvailPage_ = pPage_;
+  }
+  if (nTrimThreshold_)
+    setTrimThreshold(nTrimThreshold_); // Not to trim the reserve right away
+}
+
+//========================================================================================
+// BitmapPageChain unittests
+//________________________________________________________________________________________
+void test_BitmapPageChain()
+{
+  // Whatever the order of the returns, the blocks of a Page go out in address order:
+  BitmapPageChain chain;
+  chain.nBlockSize_ = 3 * cnMinAlign;
+  chain.reserve(1000);
+  RG_EXPECT(BitmapPage::countPages(chain.pPage_) == 1 && chain.hasFreeBlocks());
+  std::vector<void*> blocks;
+  for (int j = 0; j < 1000; ++j)
+    blocks.push_back(chain.takeBlock());
+  RG_EXPECT(std::is_sorted(blocks.begin(), blocks.end(), std::less<void*>()));
+  for (int j = 0; j < 1000; ++j)
+    chain.returnBlock(blocks[j * 7 % 1000]);
+  std::vector<void*> taken;
+  for (int j = 0; j < 1000; ++j)
+    taken.push_back(chain.takeBlock());
+  RG_EXPECT(taken == blocks && chain.nLiveBlocks_ == 1000);
+
+  // Past the reserve, new Pages; a full Page serves again once a block of it returns:
+  while (BitmapPage::countPages(chain.pPage_) < 3)
+    blocks.push_back(chain.takeBlock());
+  chain.returnBlock(blocks[500]);
+  RG_EXPECT(chain.takeBlock() == blocks[500]);
+  size_t nFound = 0;
+  for (void* b : blocks)
+  {
+    BitmapPage* p = chain.findPage(b);
+    nFound += p->isLiveBlock(b) && 
+              (char*) b > (char*) p && (char*) b < (char*) p + p->getByteSize();
+  }
+  RG_EXPECT(nFound == blocks.size());
+
+  // The Pages without live blocks are reclaimed; the others still serve:
+  BitmapPage* pOldest = chain.findPage(blocks[0]);
+  std::vector<void*> kept;
+  for (void* b : blocks)
+    if (chain.findPage(b) == pOldest)
+      chain.returnBlock(b);
+    else
+      kept.push_back(b);
+  size_t nBlockCount = chain.nBlockCount_;
+  chain.trim();
+  RG_EXPECT(chain.nBlockCount_ < nBlockCount && BitmapPage::countPages(chain.pPage_) == 2);
+  RG_EXPECT(chain.nLiveBlocks_ == kept.size() && chain.hasFreeBlocks());
+  for (void* b : kept)
+    chain.returnBlock(b);
+  chain.trim();
+  RG_EXPECT(!chain.pPage_ && !chain.hasFreeBlocks() && chain.nBlockCount_ == 0);
+  RG_EXPECT(chain.takeBlock() && chain.nPageShift_ == 
+              BitmapPage::calcFirstPageShift(3 * cnMinAlign));
+  chain.deleteAllPages();
+  RG_EXPECT(!chain.hasFreeBlocks());
+}
+
+RG_ADD_UNITTEST2(test_BitmapPageChain, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// ArrayCache ///////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//========================================================================================
+// The smallest 'n' such that (1 << n) >= nByteSize.
+//________________________________________________________________________________________
+size_t ArrayCache::calcSizeClass(size_t nByteSize)
+{
+  size_t nRet = cnMinSizeClass;
+  while ((size_t(1) << nRet) < nByteSize)
+    ++nRet;
+  return nRet;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void* ArrayCache::takeArray(size_t nByteSize)
+{
+  size_t nClass = calcSizeClass(nByteSize);
+  assert (nClass <= cnMaxSizeClass);
+
+  if (FreeBlock* ret = apFreeArrays_[nClass])
+  {
+    apFreeArrays_[nClass] = ret->pNextBlock_;
+    return ret;
+  }
+  return pBackend_->allocateRaw(size_t(1) << nClass);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ArrayCache::returnArray(void* array, size_t nByteSize)
+{
+  assert (array);
+  size_t nClass = calcSizeClass(nByteSize);
+  assert (nClass <= cnMaxSizeClass);
+
+  auto fb = (FreeBlock*) array;
+  fb->pNextBlock_ = apFreeArrays_[nClass];
+  apFreeArrays_[nClass] = fb;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void ArrayCache::releaseAll()
+{
+  for (auto& head : apFreeArrays_)
+    while (FreeBlock* fb = head)
+    {
+      head = fb->pNextBlock_;
+      pBackend_->deallocateRaw(fb);
+    }
+}
+
+//========================================================================================
+// ArrayCache unittests
+//________________________________________________________________________________________
+void test_ArrayCache()
+{
+  RG_EXPECT(ArrayCache::calcSizeClass(0) == ArrayCache::cnMinSizeClass);
+  RG_EXPECT(ArrayCache::calcSizeClass(1) == ArrayCache::cnMinSizeClass);
+  RG_EXPECT(ArrayCache::calcSizeClass(1024) == 10);
+  RG_EXPECT(ArrayCache::calcSizeClass(1025) == 11);
+  RG_EXPECT(ArrayCache::calcSizeClass(cnMaxCachedArrayByteSize_) 
+              == ArrayCache::cnMaxSizeClass);
+
+  ArrayCache ac;
+  void* a1 = ac.takeArray(100);
+  void* a2 = ac.takeArray(100);
+  RG_EXPECT(a1 && a2 && a1 != a2);
+  ac.returnArray(a1, 100);
+  RG_EXPECT(ac.takeArray(128) == a1); // Same size class
+  ac.returnArray(a1, 100);
+  ac.returnArray(a2, 100);
+  void* a3 = ac.takeArray(129);
+  RG_EXPECT(a3 != a1 && a3 != a2);
+  ac.returnArray(a3, 129);
+  ac.releaseAll();
+  void* a4 = ac.takeArray(cnMaxCachedArrayByteSize_);
+  RG_EXPECT(a4);
+  ac.returnArray(a4, cnMaxCachedArrayByteSize_);
+  ac.releaseAll();
+}
+
+RG_ADD_UNITTEST2(test_ArrayCache, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////// RemoteFreeLists /////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//========================================================================================
+//________________________________________________________________________________________
+RemoteFreeLists::RemoteFreeLists()
+{
+  for (auto& l : apLists_)
+    l.store(nullptr, std::memory_order_relaxed);
+}
+
+//========================================================================================
+// RemoteFreeLists unittests
+//________________________________________________________________________________________
+void test_RemoteFreeLists()
+{
+  RemoteFreeLists lists;
+  RG_EXPECT(!lists.takeAll(8) && !lists.takeAll(cnMaxBlockSize_));
+
+  // Several threads pushing to the same list:
+  const size_t cnThreads = 4, cnBlocks = 1000;
+  std::vector<FreeBlock> blocks(cnThreads * cnBlocks);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < cnThreads; ++t)
+    threads.emplace_back([&lists, &blocks, t]()
+    {
+      for (size_t j = 0; j < cnBlocks; ++j)
+        lists.push(&blocks[t * cnBlocks + j], 2 * cnMinAlign);
+    });
+  for (auto& t : threads)
+    t.join();
+
+  RG_EXPECT(!lists.takeAll(cnMinAlign));
+  std::vector<FreeBlock*> taken;
+  for (FreeBlock* b = lists.takeAll(2 * cnMinAlign); b; b = b->pNextBlock_)
+    taken.push_back(b);
+  std::sort(taken.begin(), taken.end());
+  RG_EXPECT(taken.size() == blocks.size() && taken.front() == &blocks.front() &&
+            std::adjacent_find(taken.begin(), taken.end()) == taken.end());
+  RG_EXPECT(!lists.takeAll(2 * cnMinAlign));
+}
+
+RG_ADD_UNITTEST2(test_RemoteFreeLists, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PagePool /////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename Chain>
+BasicPagePool<Chain>* BasicPagePool<Chain>::create(const BackendAllocator* backend, 
+                                                  const PageGrowth&       growth)
+{
+  void* rawMemory = theBackendAllocator->allocateRaw(sizeof(BasicPagePool));
+  BasicPagePool* ret = new (rawMemory) BasicPagePool;
+  ret->pBackend_ = ret->firstChain_.pBackend_ = backend;
+  ret->growth_ = growth;
+  ret->firstChain_.pStats_ = &ret->stats_;
+  return ret;
+}
+
+//========================================================================================
+// Delete all the Pages of all chains, the extra chains, and then the pool itself.
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::destroy(BasicPagePool* pool)
+{
+  assert (pool);
+
+  pool->firstChain_.deleteAllPages();
+  for (Chain* c = pool->firstChain_.pNextChain_; c; /**/)
+  {
+    Chain* next = c->pNextChain_;
+    c->deleteAllPages();
+    c->~Chain();
+    theBackendAllocator->deallocateRaw(c);
+    c = next;
+  }
+
+  if (ArrayCache* ac = pool->pArrayCache_)
+  {
+    ac->releaseAll();
+    ac->~ArrayCache();
+    theBackendAllocator->deallocateRaw(ac);
+  }
+
+  if (RemoteFreeLists* rf = pool->pRemoteFrees_.load())
+  {
+    rf->~RemoteFreeLists();
+    theBackendAllocator->deallocateRaw(rf);
+  }
+
+  pool->~BasicPagePool();
+  theBackendAllocator->deallocateRaw(pool);
+}
+
+//========================================================================================
+// Takes the embedded chain if still unused; otherwise allocates a new one and links it 
+// right after the embedded chain.
+//________________________________________________________________________________________
+template <typename Chain>
+Chain* BasicPagePool<Chain>::addNewChain(size_t nBlockSize)
+{
+  assert (nBlockSize > 0 && nBlockSize == roundUp(nBlockSize, cnMinAlign));
+  assert (!findChain(nBlockSize));
+  claimOwnerThread(); // Every Page allocation creates a chain first
+
+  Chain* ret = &firstChain_;
+  if (ret->nBlockSize_)
+  {
+    void* rawMemory = theBackendAllocator->allocateRaw(sizeof(Chain));
+    ret = new (rawMemory) Chain;
+    ret->pNextChain_ = firstChain_.pNextChain_;
+    firstChain_.pNextChain_ = ret;
+  }
+  ret->nBlockSize_ = nBlockSize;
+  ret->pBackend_ = pBackend_;
+  ret->pStats_ = &stats_;
+  ret->setGrowth(growth_);
+  if (nTrimThreshold_)
+    ret->setTrimThreshold(nTrimThreshold_);
+  ret->setSortThreshold(nSortThreshold_);
+  return ret;
+}
+
+//========================================================================================
+// Called by a non-owner thread. The RemoteFreeLists are created by the first such 
+// call; when several threads race to do it, only one wins.
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::returnRemoteBlock(void* block, size_t nBlockSize)
+{
+  RemoteFreeLists* rf = pRemoteFrees_.load(std::memory_order_acquire);
+  if (!rf)
+  {
+    void* rawMemory = theBackendAllocator->allocateRaw(sizeof(RemoteFreeLists));
+    RemoteFreeLists* created = new (rawMemory) RemoteFreeLists;
+    if (pRemoteFrees_.compare_exchange_strong(rf, created, std::memory_order_acq_rel))
+      rf = created;
+    else
+    {
+      created->~RemoteFreeLists();
+      theBackendAllocator->deallocateRaw(created);
+    }
+  }
+  rf->push(block, nBlockSize);
+}
+
+//========================================================================================
+// Returns to 'c' the blocks of its size deallocated by other threads.
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::drainRemoteBlocks(Chain* c)
+{
+  RemoteFreeLists* rf = pRemoteFrees_.load(std::memory_order_acquire);
+  for (FreeBlock* b = rf->takeAll(c->nBlockSize_); b; /**/)
+  {
+    FreeBlock* next = b->pNextBlock_;
+    c->returnBlock(b);
+    b = next;
+  }
+}
+
+//========================================================================================
+// Only the owner thread may touch the chains; the others leave the blocks for it.
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::drainAllRemoteBlocks()
+{
+  if (!pRemoteFrees_.load(std::memory_order_relaxed) || !isOwnerThread())
+    return;
+  for (Chain* c = &firstChain_; c; c = c->pNextChain_)
+    if (c->nBlockSize_)
+      drainRemoteBlocks(c);
+}
+
+//========================================================================================
+// Also releases the cached arrays. The blocks freed by other threads are drained 
+// first, so that their Pages can be released too.
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::trim()
+{
+  drainAllRemoteBlocks();
+  for (Chain* c = &firstChain_; c; c = c->pNextChain_)
+    if (c->nBlockSize_)
+      c->trim();
+  if (pArrayCache_)
+    pArrayCache_->releaseAll();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::setTrimThreshold(size_t nFreeBytes)
+{
+  nTrimThreshold_ = nFreeBytes;
+  for (Chain* c = &firstChain_; c; c = c->pNextChain_)
+    if (c->nBlockSize_)
+      c->setTrimThreshold(nFreeBytes);
+}
+
+//========================================================================================
+// The blocks freed by other threads are drained first, so that they get sorted too.
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::sortFreeBlocks()
+{
+  assert (isOwnerThread());
+  drainAllRemoteBlocks();
+  for (Chain* c = &firstChain_; c; c = c->pNextChain_)
+    if (c->nBlockSize_)
+      c->sortFreeBlocks();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::setSortThreshold(size_t nReturns)
+{
+  nSortThreshold_ = nReturns;
+  for (Chain* c = &firstChain_; c; c = c->pNextChain_)
+    if (c->nBlockSize_)
+      c->setSortThreshold(nReturns);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::reserve(size_t nBlocks, size_t nUserSize)
+{
+  assert (nUserSize > 0 && nUserSize <= cnMaxBlockSize_);
+  getOrCreateChain(nUserSize)->reserve(nBlocks);
+}
+
+//========================================================================================
+// The block sizes of 'model' are those of its chains, which map to the same chains here
+// (a block size is its own chain's size). Its remotely freed blocks are not live.
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::reserveLike(BasicPagePool* model, size_t nMaxBlocks)
+{
+  model->drainAllRemoteBlocks();
+  for (Chain* c = &model->firstChain_; c; c = c->pNextChain_)
+    if (c->nBlockSize_ && c->nLiveBlocks_)
+      reserve(std::min(c->nLiveBlocks_, nMaxBlocks), c->nBlockSize_);
+}
+
+//========================================================================================
+// Arrays small enough are recycled through the ArrayCache; the rest go to the backend.
+// Both reach the backend through a virtual call (PrivateAllocator<> calls the policy 
+// directly for arrays larger than cnMaxCachedArrayByteSize_, without the pool).
+//________________________________________________________________________________________
+template <typename Chain>
+void* BasicPagePool<Chain>::allocateArray(size_t nByteSize)
+{
+  claimOwnerThread();
+  addFallback();
+  if (nByteSize > cnMaxCachedArrayByteSize_)
+    return pBackend_->allocateRaw(nByteSize);
+
+  if (!pArrayCache_)
+  {
+    void* rawMemory = theBackendAllocator->allocateRaw(sizeof(ArrayCache));
+    pArrayCache_ = new (rawMemory) ArrayCache;
+    pArrayCache_->pBackend_ = pBackend_;
+  }
+  return pArrayCache_->takeArray(nByteSize);
+}
+
+//========================================================================================
+// Without an ArrayCache, the array was allocated by another clique (before a container
+// replaced its allocator); arrays are interchangeable between cliques of the same 
+// backend.
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::deallocateArray(void* array, size_t nByteSize)
+{
+  if (nByteSize > cnMaxCachedArrayByteSize_ || !isOwnerThread() || !pArrayCache_)
+    return pBackend_->deallocateRaw(array);
+
+  pArrayCache_->returnArray(array, nByteSize);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename Chain>
+void BasicPagePool<Chain>::addFallback()
+{
+  bFallbacks_ = true;
+  stats_.addFallback();
+  statsAddFallback();
+}
+
+//========================================================================================
+// Walks the chains, not the blocks - except for those freed by other threads, which 
+// are drained first (on the owner thread), not to count as live.
+//________________________________________________________________________________________
+template <typename Chain>
+AllocatorStats BasicPagePool<Chain>::getStats()
+{
+  AllocatorStats ret;
+  #if RG_PRIVATEALLOCATOR_STATS
+    drainAllRemoteBlocks();
+    stats_.addTo(&ret);
+    for (Chain* c = &firstChain_; c; c = c->pNextChain_)
+    {
+      ret.nLiveBlocks += c->nLiveBlocks_;
+      ret.nFreeBlocks += c->nBlockCount_ - c->nLiveBlocks_;
+    }
+  #endif
+  return ret;
+}
+
+template class BasicPagePool<PageChain>;
+template class BasicPagePool<BitmapPageChain>;
+
+//========================================================================================
+// PagePool unittests
+//________________________________________________________________________________________
+void test_PagePool()
+{
+  PagePool* pool = PagePool::create();
+  RG_EXPECT(pool && !pool->findChain(8));
+
+  void* b1 = pool->takeBlock(8);
+  void* b2 = pool->takeBlock(cnMaxBlockSize_);
+  void* b3 = pool->takeBlock(cnMinAlign + 1);
+  RG_EXPECT(b1 && b2 && b3 && b1 != b2 && b2 != b3);
+
+  PageChain *c1 = pool->findChain(8), 
+            *c2 = pool->findChain(cnMaxBlockSize_),
+            *c3 = pool->findChain(cnMinAlign + 1);
+  RG_EXPECT(c1 && c2 && c3 && c1 != c2 && c2 != c3 && c1 != c3);
+  RG_EXPECT(c2->nBlockSize_ == cnMaxBlockSize_);
+  RG_EXPECT(c3->nBlockSize_ == 2 * cnMinAlign);
+  RG_EXPECT(c3 == pool->findChain(2 * cnMinAlign));
+  RG_EXPECT(c2->pPage_ && c2->pPage_->getBlockSize() == cnMaxBlockSize_);
+
+  size_t nFree = c2->pPage_->countFreeBlocks();
+  pool->returnBlock(b2, cnMaxBlockSize_);
+  RG_EXPECT(c2->pPage_->countFreeBlocks() == nFree + 1);
+  RG_EXPECT(pool->takeBlock(cnMaxBlockSize_) == b2);
+
+  void* a1 = pool->allocateArray(1000);
+  void* a2 = pool->allocateArray(cnMaxCachedArrayByteSize_ + 1);
+  RG_EXPECT(a1 && a2);
+  pool->deallocateArray(a1, 1000);
+  pool->deallocateArray(a2, cnMaxCachedArrayByteSize_ + 1);
+  RG_EXPECT(pool->allocateArray(1024) == a1); // Recycled
+  pool->deallocateArray(a1, 1024);            // Cached; released with the pool
+
+  pool->returnBlock(b1, 8);
+  pool->returnBlock(b3, cnMinAlign + 1);
+  pool->trim(); // All blocks of c1 and c3 are free
+  RG_EXPECT(!c1->pPage_ && c1->nBlockCount_ == 0 && !c3->pPage_);
+  RG_EXPECT(c2->pPage_ && c2->nLiveBlocks_ == 1);
+  RG_EXPECT(pool->takeBlock(8) && c1->pPage_);
+
+  // Blocks and arrays deallocated by another thread:
+  std::vector<void*> blocks;
+  for (int j = 0; j < 100; ++j)
+    blocks.push_back(pool->takeBlock(cnMaxBlockSize_));
+  a1 = pool->allocateArray(1000);
+  size_t nBlockCount = c2->nBlockCount_,
+         nLive = c2->nLiveBlocks_;
+  std::thread([&]()
+  {
+    RG_EXPECT(!pool->isOwnerThread());
+    for (auto b : blocks)
+      pool->returnBlock(b, cnMaxBlockSize_);
+    pool->deallocateArray(a1, 1000); // To the backend
+  }).join();
+  RG_EXPECT(c2->nLiveBlocks_ == nLive); // Not drained yet
+
+  while (c2->hasFreeBlocks())
+    pool->takeBlock(cnMaxBlockSize_);
+  RG_EXPECT(c2->nBlockCount_ == nBlockCount && c2->nLiveBlocks_ == nBlockCount);
+  void* b = pool->takeBlock(cnMaxBlockSize_); // Drains
+  RG_EXPECT(std::count(blocks.begin(), blocks.end(), b) == 1);
+  RG_EXPECT(c2->nBlockCount_ == nBlockCount && c2->hasFreeBlocks());
+  PagePool::destroy(pool);
+
+  // Owned by the first allocating thread, rather than by the creating one:
+  pool = PagePool::create();
+  RG_EXPECT(pool->isOwnerThread());
+  std::thread([&]()
+  {
+    pool->returnBlock(pool->takeBlock(8), 8);
+    RG_EXPECT(pool->isOwnerThread() && pool->findChain(8)->nLiveBlocks_ == 0);
+  }).join();
+  RG_EXPECT(!pool->isOwnerThread());
+  PagePool::destroy(pool);
+
+  // Cache-line blocks: the sizes below a cache line round up to its divisors:
+  PageGrowth growth;
+  growth.bCacheLineBlocks = true;
+  pool = PagePool::create(theBackendAllocator, growth);
+  RG_EXPECT(pool->calcBlockSize(1) == cnMinAlign && pool->calcBlockSize(24) == 32);
+  RG_EXPECT(pool->calcBlockSize(40) == 64 && pool->calcBlockSize(56) == 64);
+  RG_EXPECT(pool->calcBlockSize(96) == 96);
+  b = pool->takeBlock(24);
+  RG_EXPECT((size_t(b) & 31) == 0 && pool->findChain(24) == pool->findChain(32));
+  RG_EXPECT(pool->findChain(32)->nBlockSize_ == 32);
+  pool->returnBlock(b, 24);
+  PagePool::destroy(pool);
+}
+
+RG_ADD_UNITTEST2(test_PagePool, 1);
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PageHandle ///////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+//========================================================================================
+// PaHandle unittests
+//________________________________________________________________________________________
+void test_PaHandle()
+{
+  PageHandle n1, n2;
+  RG_EXPECT(!n1.pPool_ && !n1.inSameClique(&n2) && n1.inSameClique(&n1));
+
+  auto pool = n1.getOrCreatePool();
+  RG_EXPECT(n1.getOrCreatePool() == pool && pool->getRefCount() == 1);
+  n2.share(pool);
+  RG_EXPECT(n2.pPool_ == pool && n1.inSameClique(&n2) && n2.inSameClique(&n1));
+  RG_EXPECT(pool->getRefCount() == 2);
+
+  // The pool outlives the handle that created it:
+  n1.release();
+  RG_EXPECT(!n1.pPool_ && !n1.inSameClique(&n2));
+  RG_EXPECT(n2.getOrCreatePool() == pool);
+  {
+    PageHandle n3;
+    n3.share(pool);
+    n2.release();
+    RG_EXPECT(n3.pPool_ == pool);
+  } // The last reference: destroys the pool
+  RG_EXPECT(!n2.pPool_);
 };
 
 RG_ADD_UNITTEST2(test_PaHandle, 1);
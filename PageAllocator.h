@@ -15,8 +15,41 @@
 #include <utility>  // std::swap
 #include <cstdio> 
 #include <cstddef> // max_align_t
+#include <cstdint> // uint32_t
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+
+#include "BackendAllocators.h"
+
+// ------------------------------------- Configuration -----------------------------------
+
+// Define as 0 to compile out all the statistics counting (see AllocatorStats).
+#ifndef RG_PRIVATEALLOCATOR_STATS
+  #define RG_PRIVATEALLOCATOR_STATS 1
+#endif
+
+// The vector instructions scanning the BitmapPage bitmaps: 2 for AVX2, 1 for SSE2, 0 
+// for none (plain C++). By default, the best that the compiler targets (e.g. AVX2 with
+// -mavx2 or -march=native).
+#ifndef RG_PRIVATEALLOCATOR_SIMD
+  #if defined(__AVX2__)
+    #define RG_PRIVATEALLOCATOR_SIMD 2
+  #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define RG_PRIVATEALLOCATOR_SIMD 1
+  #else
+    #define RG_PRIVATEALLOCATOR_SIMD 0
+  #endif
+#endif
+
+#if RG_PRIVATEALLOCATOR_SIMD >= 2
+  #include <immintrin.h>
+#elif RG_PRIVATEALLOCATOR_SIMD
+  #include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+  #include <intrin.h> // _BitScanForward64
+#endif
 
 // ------------------------------------- Definitions -------------------------------------
 
@@ -32,8 +65,20 @@ namespace rg_privateallocator
 // The maximal size that PrivateAllocator considers for management.
 const size_t cnMaxBlockSize_ = 128;
 
+// Page byte sizes are powers of 2; Pages are aligned to their size (see PageTable).
+// The smallest and the largest Pages are 2^cnMinPageShift_ and 2^cnMaxPageShift_ bytes.
+// A backend may allow larger Pages (see BackendAllocator::getMaxPageShift()), up to 
+// 2^cnMaxHugePageShift_ bytes.
+const size_t cnMinPageShift_ = 6;
+const size_t cnMaxPageShift_ = 17;
+const size_t cnMaxHugePageShift_ = 21;
+
 // The maximal size (in bytes) that of a single Page 
-const size_t cnMaxPageByteSize_ = 100*1000u; 
+const size_t cnMaxPageByteSize_ = size_t(1) << cnMaxPageShift_; 
+
+// The largest array (i.e. n > 1 allocation) kept for reuse by PagePool, in bytes.
+// Must be a power of 2. Larger arrays are always returned to the backend.
+const size_t cnMaxCachedArrayByteSize_ = 1024*1024;
 
 // User sizes and all adresses are assumed/forced to round/align to this:
 const size_t cnMinAlign = sizeof(void*) > 8 ? sizeof(void*) : 8;
@@ -43,6 +88,13 @@ const size_t cnMaxAlign = alignof(::std::max_align_t);
 
 static_assert (cnMaxAlign >= cnMinAlign, "cnMaxAlign < cnMinAlign");
 
+// The (assumed) CPU cache line size; see PageGrowth::bCacheLineBlocks and nPageColors.
+const size_t cnCacheLineSize = 64;
+
+// The most Page colors (see PageGrowth::nPageColors): as many as the sets of a typical 
+// L1 data cache.
+const size_t cnMaxPageColors_ = 64;
+
 
 //========================================================================================
 // Smallest value >= 'value' divisible by 'alighment' (alignment assumed to be power of 2)
@@ -69,6 +121,32 @@ inline size_t roundUp(size_t value, size_t alignment)
   return (value + alignment - 1) & ~(alignment - 1); 
 }
 
+//========================================================================================
+// The index of the lowest set bit of 'word' (not 0).
+//________________________________________________________________________________________
+inline size_t findFirstSetBit(uint64_t word)
+{
+  assert (word != 0);
+  #if defined(__GNUC__) || defined(__clang__)
+    return size_t(__builtin_ctzll(word));
+  #elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long nIndex;
+    _BitScanForward64(&nIndex, word);
+    return nIndex;
+  #else
+    size_t nIndex = 0;
+    for (/**/; (word & 1) == 0; word >>= 1)
+      ++nIndex;
+    return nIndex;
+  #endif
+}
+
+//========================================================================================
+// The index of the first non-zero word in [nBegin, nEnd) of 'words', or nEnd if none; 
+// with vector instructions, as of RG_PRIVATEALLOCATOR_SIMD.
+//________________________________________________________________________________________
+size_t findNonZeroWord(const uint64_t* words, size_t nBegin, size_t nEnd);
+
 //****************************************************************************************
 // (Free-block *header* in Page
 // Actual blocks are of potentially larger size.
@@ -81,7 +159,122 @@ struct alignas(cnMinAlign) FreeBlock
   FreeBlock* pNextBlock_; // Linked list of *free* blocks; 
 };
 
-class Page; // fwd
+template <typename PageHeader> class BasicPage; // fwd
+class SimplePageHeader; // fwd
+class BitmapPageHeader; // fwd
+typedef BasicPage<SimplePageHeader> Page; // The Page of the allocators, by default
+typedef BasicPage<BitmapPageHeader> BitmapPage; // Selected by AllocatorTraits
+template <typename PageT> class BasicPageTable; // fwd
+typedef BasicPageTable<Page> PageTable;
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// Statistics ///////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// Allocation statistics, of a clique (see PagePool::getStats()), of the calling thread
+// (getThreadStats()) or of the whole process (getProcessStats()). 
+// The Pages of a thread or the process are all the Pages held from the backend, 
+// including those in PageCache. A thread's counts are net of the Pages it allocated 
+// and freed, so they wrap around (below 0) in a thread freeing others' Pages.
+// Fallbacks are the allocations not served by Pages: arrays (n > 1) and blocks larger 
+// than cnMaxBlockSize_.
+// The blocks are counted per clique only; those freed by other threads but not yet 
+// drained count as live.
+// All zeros when RG_PRIVATEALLOCATOR_STATS is 0.
+//________________________________________________________________________________________
+struct AllocatorStats
+{
+  size_t nPages = 0;
+  size_t nPageBytes = 0;
+  size_t nPeakPageBytes = 0;
+  size_t nLiveBlocks = 0;
+  size_t nFreeBlocks = 0; // Including the not carved yet
+  size_t nFallbacks = 0;
+};
+
+AllocatorStats getThreadStats();
+AllocatorStats getProcessStats();
+
+//****************************************************************************************
+// The counters behind AllocatorStats, updated off the block hot paths: once per Page or 
+// per fallback. Counter is size_t for a clique or a thread, and std::atomic<size_t> 
+// (relaxed) for the process.
+//________________________________________________________________________________________
+template <typename Counter>
+class StatsCounters
+{
+  Counter nPages_{0};
+  Counter nPageBytes_{0};
+  Counter nPeakPageBytes_{0};
+  Counter nFallbacks_{0};
+
+  // Return the new value:
+  static size_t add(size_t& n, size_t delta) { return n += delta; }
+  static size_t add(std::atomic<size_t>& n, size_t delta) 
+    { return n.fetch_add(delta, std::memory_order_relaxed) + delta; }
+  static void raise(size_t& peak, size_t value) { peak = std::max(peak, value); }
+  static void raise(std::atomic<size_t>& peak, size_t value);
+
+public:
+  void addPage(size_t nByteSize);
+  void removePages(size_t nPages, size_t nByteSize);
+  void addFallback();
+  void addTo(AllocatorStats* stats) const; // Adds the counts to 'stats'
+};
+
+template <typename Counter>
+inline void StatsCounters<Counter>::raise(std::atomic<size_t>& peak, size_t value)
+{
+  size_t n = peak.load(std::memory_order_relaxed);
+  while (n < value && !peak.compare_exchange_weak(n, value, std::memory_order_relaxed))
+    {}
+}
+
+template <typename Counter>
+inline void StatsCounters<Counter>::addPage(size_t nByteSize)
+{
+  #if RG_PRIVATEALLOCATOR_STATS
+    add(nPages_, 1);
+    raise(nPeakPageBytes_, add(nPageBytes_, nByteSize));
+  #else
+    (void) nByteSize;
+  #endif
+}
+
+template <typename Counter>
+inline void StatsCounters<Counter>::removePages(size_t nPages, size_t nByteSize)
+{
+  #if RG_PRIVATEALLOCATOR_STATS
+    add(nPages_, size_t(0) - nPages);
+    add(nPageBytes_, size_t(0) - nByteSize);
+  #else
+    (void) nPages, (void) nByteSize;
+  #endif
+}
+
+template <typename Counter>
+inline void StatsCounters<Counter>::addFallback()
+{
+  #if RG_PRIVATEALLOCATOR_STATS
+    add(nFallbacks_, 1);
+  #endif
+}
+
+template <typename Counter>
+inline void StatsCounters<Counter>::addTo(AllocatorStats* stats) const
+{
+  stats->nPages += nPages_;
+  stats->nPageBytes += nPageBytes_;
+  stats->nPeakPageBytes += nPeakPageBytes_;
+  stats->nFallbacks += nFallbacks_;
+}
+
+// Update the calling thread's and the process counters:
+void statsAddBackendPage(size_t nByteSize);    // Allocated from the backend
+void statsRemoveBackendPage(size_t nByteSize); // Returned to it
+void statsAddFallback();
 
 //////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////// SimplePageHeader /////////////////////////////////////
@@ -93,9 +286,13 @@ class Page; // fwd
 //________________________________________________________________________________________
 class alignas(cnMaxAlign) SimplePageHeader
 {
-  size_t        nBlockSize_; 
-  Page*         pNextPage_;
-  FreeBlock* pFirstBlock_; 
+  void*         pNextPage_;
+  FreeBlock*    pFirstBlock_; 
+  uint32_t      nBlockSize_; 
+  uint16_t      nPageShift_;
+  uint16_t      nFirstBlockOffset_;
+  uint32_t      nLiveBlocks_;
+  uint32_t      nBumpOffset_;
 
 public:
   
@@ -103,23 +300,96 @@ public:
   void setBlockSize(size_t);
   size_t getBlockSize();
 
-  void setNextPage(Page* p);
-  Page* getNextPage();
+  void setNextPage(void* p);
+  void* getNextPage();
 
   void setFirstBlock(FreeBlock* b);
   FreeBlock* getFirstBlock();
+
+  void setPageShift(size_t n);
+  size_t getPageShift();
+
+  void setLiveBlockCount(size_t n);
+  size_t getLiveBlockCount();
+
+  void setBumpOffset(size_t n);
+  size_t getBumpOffset();
+
+  void setFirstBlockOffset(size_t n);
+  size_t getFirstBlockOffset();
 };
 
+// Inline, since these are on the allocation fast path:
+inline void SimplePageHeader::setBlockSize(size_t nBlockSize)
+{
+  nBlockSize_ = uint32_t(nBlockSize);
+}
+
 inline size_t SimplePageHeader::getBlockSize()
 {
   return nBlockSize_;
 }
 
+inline void SimplePageHeader::setNextPage(void* p)
+{
+  pNextPage_ = p;
+}
+
+inline void* SimplePageHeader::getNextPage()
+{
+  return pNextPage_;
+}
+
+inline void SimplePageHeader::setFirstBlock(FreeBlock* b)
+{
+  pFirstBlock_ = b;
+}
+
 inline FreeBlock* SimplePageHeader::getFirstBlock()
 {
   return pFirstBlock_;
 }
 
+inline void SimplePageHeader::setPageShift(size_t n)
+{
+  nPageShift_ = uint16_t(n);
+}
+
+inline size_t SimplePageHeader::getPageShift()
+{
+  return nPageShift_;
+}
+
+inline void SimplePageHeader::setLiveBlockCount(size_t n)
+{
+  nLiveBlocks_ = uint32_t(n);
+}
+
+inline size_t SimplePageHeader::getLiveBlockCount()
+{
+  return nLiveBlocks_;
+}
+
+inline void SimplePageHeader::setBumpOffset(size_t n)
+{
+  nBumpOffset_ = uint32_t(n);
+}
+
+inline size_t SimplePageHeader::getBumpOffset()
+{
+  return nBumpOffset_;
+}
+
+inline void SimplePageHeader::setFirstBlockOffset(size_t n)
+{
+  nFirstBlockOffset_ = uint16_t(n);
+}
+
+inline size_t SimplePageHeader::getFirstBlockOffset()
+{
+  return nFirstBlockOffset_;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////// PackedPageHeader //////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -127,7 +397,9 @@ inline FreeBlock* SimplePageHeader::getFirstBlock()
 
 //****************************************************************************************
 // Alternative to SimplePageHeader.
-// Here data is packed in bitfields in order to fit to 2*sizeof(size_t)
+// Here the pointers and the block size are packed in bitfields in order to fit to 
+// 2*sizeof(size_t); the page shift, the first block offset, the live-block count and 
+// the bump offset follow.
 //________________________________________________________________________________________
 class alignas(cnMaxAlign) PackedPageHeader
 {
@@ -136,92 +408,323 @@ class alignas(cnMaxAlign) PackedPageHeader
   size_t nBlockSizeMSB_ : 3;        // half the bits of block size
   size_t nFirstBlockMSB_: sizeBits; // First block ptr >> 3
   size_t nBlockSizeLSB_ : 3;        // the other half of the bits for block size
+  uint16_t nPageShift_;
+  uint16_t nFirstBlockOffset_;
+  uint32_t nLiveBlocks_;
+  uint32_t nBumpOffset_;
 public:
 // Direct/low-level data get/set
   void setBlockSize(size_t nBlockSize);
   size_t getBlockSize();
 
-  void setNextPage(Page* p);
-  Page* getNextPage();
+  void setNextPage(void* p);
+  void* getNextPage();
 
   void setFirstBlock(FreeBlock* b);
   FreeBlock* getFirstBlock();
+
+  void setPageShift(size_t n);
+  size_t getPageShift();
+
+  void setLiveBlockCount(size_t n);
+  size_t getLiveBlockCount();
+
+  void setBumpOffset(size_t n);
+  size_t getBumpOffset();
+
+  void setFirstBlockOffset(size_t n);
+  size_t getFirstBlockOffset();
 };
 
-static_assert(sizeof(PackedPageHeader) == 2 * sizeof(size_t), 
+static_assert(sizeof(PackedPageHeader) <= sizeof(SimplePageHeader), 
               "PackedPageHeader too large");
 
+inline void PackedPageHeader::setBlockSize(size_t nBlockSize)
+{
+  nBlockSizeLSB_ = (nBlockSize >> 3) & 0x7;
+  nBlockSizeMSB_ = nBlockSize >> 6;
+}
+
 inline size_t PackedPageHeader::getBlockSize()
 {
   return (nBlockSizeMSB_ << 6) + (nBlockSizeLSB_ << 3);
 }
 
+inline void PackedPageHeader::setNextPage(void* p)
+{
+  nNextPageMSB_ = size_t(p) >> 3;
+}
+
+inline void* PackedPageHeader::getNextPage()
+{
+  return (void*) (nNextPageMSB_ << 3);
+}
+
+inline void PackedPageHeader::setFirstBlock(FreeBlock* b)
+{
+  nFirstBlockMSB_ = size_t(b) >> 3;
+}
+
 inline FreeBlock* PackedPageHeader::getFirstBlock()
 {
   return (FreeBlock*) (nFirstBlockMSB_ << 3);
 }
 
+inline void PackedPageHeader::setPageShift(size_t n)
+{
+  nPageShift_ = uint16_t(n);
+}
+
+inline size_t PackedPageHeader::getPageShift()
+{
+  return nPageShift_;
+}
+
+inline void PackedPageHeader::setLiveBlockCount(size_t n)
+{
+  nLiveBlocks_ = uint32_t(n);
+}
+
+inline size_t PackedPageHeader::getLiveBlockCount()
+{
+  return nLiveBlocks_;
+}
+
+inline void PackedPageHeader::setBumpOffset(size_t n)
+{
+  nBumpOffset_ = uint32_t(n);
+}
+
+inline size_t PackedPageHeader::getBumpOffset()
+{
+  return nBumpOffset_;
+}
+
+inline void PackedPageHeader::setFirstBlockOffset(size_t n)
+{
+  nFirstBlockOffset_ = uint16_t(n);
+}
+
+inline size_t PackedPageHeader::getFirstBlockOffset()
+{
+  return nFirstBlockOffset_;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////// Page /////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 
+//****************************************************************************************
+// The operations on a list of Pages (linked through their headers) that don't depend 
+// on the Page layout; a base of all Pages, with the Page type as parameter.
+//________________________________________________________________________________________
+template <typename PageT>
+class BasicPageList
+{
+public:
+  // Creates a Page of 2^nPageShift bytes from 'backend', in front of 'pagesSoFar':
+  static PageT* addNewPage(size_t nBlockSize, 
+                           size_t nPageShift, 
+                           PageT* pagesSoFar,
+                           const BackendAllocator* backend = theBackendAllocator,
+                           size_t nPageColors = 1);
+  static void deleteAllPages(PageT* pFirstPage, 
+                             const BackendAllocator* backend = theBackendAllocator);
+  static size_t countPages(PageT* pFirstPage);
+};
+
 //****************************************************************************************
 // A single Page comprizing the pool of free blocks that PrivateAllocator<> uses.
 // 
 // The actual page memory layout is:
 // <Page> <FreeBlock...> <FreeBlock...> ... <FreeBlock...> 
 //   where FreeBlocks are of size PageHeader::getBlockSize()
-// Pages are (raw)-allocated on demand and linked in a list served for disposal only.
-// Upon creation of each page its blocks are initially chained and added to the free-block 
-// list in Pag::.header_. Thereafter, all allocation and deallocation requests are
-// served from/to this list.
+// Pages are (raw)-allocated on demand, at addresses aligned to their (power of 2) byte
+// size, and linked in a list served for disposal and reclamation only.
+// A new Page is only added when the previous one has no free blocks left. It takes over 
+// the (empty) free-block list in Page::header_, and leaves its blocks untouched: they 
+// are carved one by one, at the bump offset, once that list is empty. Returned blocks 
+// go to the list, and are served from it first.
+// reclaimFreePages() finds the Pages whose blocks are all in the free list (through 
+// PageTable), and returns them to the backend.
+// The free list is LIFO, so churn scatters it; sortFreeBlocks() relinks it in address 
+// order, so that the blocks are handed out sequentially again.
+// The header layout is a policy: SimplePageHeader (plain pointers, the fastest to
+// read and write; used by the Page typedef) or PackedPageHeader (bitfields).
+// With page coloring (see PageGrowth::nPageColors), the blocks start a few cache lines
+// further; the first block offset is kept in the header.
 //________________________________________________________________________________________
-class alignas(cnMaxAlign) Page
+template <typename PageHeader>
+class alignas(cnMaxAlign) BasicPage : public BasicPageList<BasicPage<PageHeader>>
 {
-  // Alternate between SimplePageHeader and PackedPageHeader:
-  #if 0
-    typedef SimplePageHeader PageHeader;
-  #else
-    typedef PackedPageHeader PageHeader;
-  #endif
-
   PageHeader header_;
 
 public:
   size_t getBlockSize();
+  size_t getPageShift();
+  size_t getByteSize(); // Including the header
+  size_t getBlockCount();
+  size_t getLiveBlockCount(); // As of the last reclaimFreePages()
+  BasicPage* getNextPage();
+  void setNextPage(BasicPage* page); // Relinks the Page list only, not the free list
+  size_t countUntouchedBlocks(); // Not carved yet
 
   bool hasFreeBlocks(); 
   void* takeBlock(); // always succeeds
+  void* tryTakeBlock(size_t nBlockSize); // nullptr if none; nBlockSize as of the chain
   void returnBlock(void* block);
+  FreeBlock* detachFreeBlocks();          // All, carving the untouched ones
+  void attachFreeBlocks(FreeBlock* list); // To a Page without a free-block list
 
-  void initialize(size_t nBlockSize, size_t nBlockCount, Page* pagesSoFar);
+  void initialize(size_t nBlockSize, 
+                  size_t nPageShift, 
+                  BasicPage* pagesSoFar, 
+                  size_t nPageColors = 1);
 
   static size_t calcMinBlockCount(size_t nBlockSize); // For the 1st page
-  static size_t calcNewPageBlockCount(size_t nBlockSize, Page* pagesSoFar);
-  static Page* addNewPage(size_t nUserSize, Page* pagesSoFar);
-  static void deleteAllPages(Page* pFirstPage);
-  size_t countFreeBlocks();
+  static size_t calcFirstPageShift(size_t nBlockSize);
+  static size_t calcNextPageShift(size_t nPageShift, 
+                                  size_t nMaxPageShift = cnMaxPageShift_,
+                                  size_t nGrowthShift = 1);
+  static size_t calcBlockCount(size_t nBlockSize, size_t nPageShift);
+  static size_t calcFirstBlockOffset(size_t nBlockSize); // The header, padded
+  static size_t calcColorOffset(const void* page, // Added to calcFirstBlockOffset()
+                                size_t nBlockSize, 
+                                size_t nPageShift, 
+                                size_t nPageColors);
+  // The Pages come from, and go back to, 'backend' (see also BasicPageList):
+  static BasicPage* reclaimFreePages(BasicPage* pFirstPage, 
+                                     BasicPageTable<BasicPage>* pTable, // nullptr: 1 Page
+                                     size_t* pnReclaimedBlocks,
+                                     const BackendAllocator* backend = theBackendAllocator);
+  static void sortFreeBlocks(BasicPage* pFirstPage); // The list it holds, by address
+  static BasicPage* alignDown(const void* block, size_t nPageShift); // Page of that size
+  size_t countFreeBlocks(); // Including the untouched ones of this Page
 };
 
-inline size_t Page::getBlockSize()
+template <typename PageHeader>
+inline size_t BasicPage<PageHeader>::getBlockSize()
 {
   return header_.getBlockSize();
 }
 
-inline bool Page::hasFreeBlocks()
+template <typename PageHeader>
+inline size_t BasicPage<PageHeader>::getPageShift()
+{
+  return header_.getPageShift();
+}
+
+template <typename PageHeader>
+inline size_t BasicPage<PageHeader>::getByteSize()
+{
+  return size_t(1) << header_.getPageShift();
+}
+
+template <typename PageHeader>
+inline size_t BasicPage<PageHeader>::getBlockCount()
+{
+  return (getByteSize() - header_.getFirstBlockOffset()) / getBlockSize();
+}
+
+//========================================================================================
+// Of an uncolored Page; coloring takes a few blocks off.
+//________________________________________________________________________________________
+template <typename PageHeader>
+inline size_t BasicPage<PageHeader>::calcBlockCount(size_t nBlockSize, size_t nPageShift)
+{
+  return ((size_t(1) << nPageShift) - calcFirstBlockOffset(nBlockSize)) / nBlockSize;
+}
+
+//========================================================================================
+// Blocks are aligned to the largest power of 2 dividing their size - i.e. at least to 
+// alignof(T) for blocks of sizeof(T), including over-aligned (e.g. alignas(64)) T - 
+// since the Page is aligned to its size, and its header is padded to that alignment.
+//________________________________________________________________________________________
+template <typename PageHeader>
+inline size_t BasicPage<PageHeader>::calcFirstBlockOffset(size_t nBlockSize)
+{
+  assert (nBlockSize > 0 && nBlockSize <= cnMaxBlockSize_);
+  return roundUp(sizeof(BasicPage), nBlockSize & (0 - nBlockSize));
+}
+
+template <typename PageHeader>
+inline BasicPage<PageHeader>* BasicPage<PageHeader>::getNextPage()
 {
-  return header_.getFirstBlock() != nullptr;
+  return (BasicPage*) header_.getNextPage();
 }
 
-inline void* Page::takeBlock()
+template <typename PageHeader>
+inline void BasicPage<PageHeader>::setNextPage(BasicPage* page)
 {
-  auto fb = header_.getFirstBlock();
-  assert(fb); // should have been checked outside
-  header_.setFirstBlock(fb->pNextBlock_);
-  return fb;
+  header_.setNextPage(page);
 }
 
-inline void Page::returnBlock(void* block)
+template <typename PageHeader>
+inline BasicPage<PageHeader>* BasicPage<PageHeader>::alignDown(const void* block, 
+                                                               size_t nPageShift)
+{
+  return (BasicPage*) (size_t(block) & ~((size_t(1) << nPageShift) - 1));
+}
+
+template <typename PageHeader>
+inline size_t BasicPage<PageHeader>::getLiveBlockCount()
+{
+  return header_.getLiveBlockCount();
+}
+
+template <typename PageHeader>
+inline size_t BasicPage<PageHeader>::countUntouchedBlocks()
+{
+  return (getByteSize() - header_.getBumpOffset()) / getBlockSize();
+}
+
+template <typename PageHeader>
+inline bool BasicPage<PageHeader>::hasFreeBlocks()
+{
+  return header_.getFirstBlock() != nullptr
+      || header_.getBumpOffset() + getBlockSize() <= getByteSize();
+}
+
+template <typename PageHeader>
+inline void* BasicPage<PageHeader>::takeBlock()
+{
+  if (auto fb = header_.getFirstBlock())
+  {
+    header_.setFirstBlock(fb->pNextBlock_);
+    return fb;
+  }
+
+  // Carve an untouched block:
+  size_t nOffset = header_.getBumpOffset();
+  assert(nOffset + getBlockSize() <= getByteSize()); // should have been checked outside
+  header_.setBumpOffset(nOffset + getBlockSize());
+  return (char*) this + nOffset;
+}
+
+//========================================================================================
+// hasFreeBlocks() and takeBlock() in one pass: the block size comes from the caller
+// (a PageChain has one), so the header is only read for the free-list head and, once 
+// that is empty, for the bump offset and the page shift.
+//________________________________________________________________________________________
+template <typename PageHeader>
+inline void* BasicPage<PageHeader>::tryTakeBlock(size_t nBlockSize)
+{
+  assert(nBlockSize == getBlockSize());
+  if (auto fb = header_.getFirstBlock())
+  {
+    header_.setFirstBlock(fb->pNextBlock_);
+    return fb;
+  }
+
+  size_t nOffset = header_.getBumpOffset();
+  if (nOffset + nBlockSize > getByteSize())
+    return nullptr;
+  header_.setBumpOffset(nOffset + nBlockSize);
+  return (char*) this + nOffset;
+}
+
+template <typename PageHeader>
+inline void BasicPage<PageHeader>::returnBlock(void* block)
 {
   assert(block);
   auto bh = (FreeBlock*) block;
@@ -229,76 +732,969 @@ inline void Page::returnBlock(void* block)
   header_.setFirstBlock(bh);
 }
 
+static_assert(2 * sizeof(Page) <= size_t(1) << cnMinPageShift_, 
+              "cnMinPageShift_ too small");
+static_assert(sizeof(Page) <= cnMaxBlockSize_ &&   // The padded header is at most that
+              2 * cnMaxBlockSize_ <= cnMaxPageByteSize_, 
+              "cnMaxPageShift_ too small");
+static_assert(NewDeleteBackend::cnMaxPageShift == cnMaxPageShift_ &&
+              MmapBackend::cnMaxPageShift <= cnMaxHugePageShift_,
+              "Backend Page size out of range");
+
 //////////////////////////////////////////////////////////////////////////////////////////
-/////////////////////////////////////// PageHandle ///////////////////////////////////////
+/////////////////////////////////////// BitmapPage ///////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 
 
 //****************************************************************************************
-// A node participating in circular list of items sharing the same Page (through pointer).
-// Embedded as data member in PrivateAllocator<>.
+// Alternative to SimplePageHeader and PackedPageHeader, selecting BasicPage<> with a
+// per-Page bitmap of the free blocks (1 for free) instead of the intrusive free list.
+// The bitmap follows the header; the blocks follow the bitmap.
 //________________________________________________________________________________________
-struct PageHandle 
+class alignas(cnMaxAlign) BitmapPageHeader
 {
-// Data
-  Page* pPage_ = nullptr; // Delay-created/updated
-  PageHandle* pNext_;  // Form a circular list of the co-owners of a Page
+  void*    pNextPage_;
+  void*    pNextAvailPage_; // Of the chain's Pages with free blocks (see BitmapPageChain)
+  uint32_t nBlockSize_;
+  uint16_t nPageShift_;
+  uint16_t nFirstBlockOffset_;
+  uint32_t nBlockCount_;
+  uint32_t nLiveBlocks_;
+  uint32_t nFirstFreeWord_; // No free blocks before that bitmap word
+  uint32_t nTouchedBlocks_; // Up to the highest block ever taken
+
+  friend class BasicPage<BitmapPageHeader>;
+};
 
-// Ctors
-  PageHandle() { pNext_ = this; }
-  
-  PageHandle(const PageHandle&) = delete;
-  PageHandle& operator=(const PageHandle&) = delete;
-
-// (Circular) list management
-  bool isSingleInList() const;
-  PageHandle* findPrevInList();
-  void addSelfToList(PageHandle* where);
-  void removeSelfFromList();
-  bool inSameList(const PageHandle* ph) const;
-
-// Page access and creation 
-  Page* getOrCreatePage(size_t nUserBlockSize, bool needFreeBlock);
+//****************************************************************************************
+// A Page with bitmap free tracking: nothing is written to a block once it is freed, 
+// the occupancy of each Page is exact at any time, and the live blocks can be listed.
+// takeBlock() hands out the lowest free block, found by scanning the bitmap from the 
+// first word that may have one (see findNonZeroWord()), so the blocks go out in 
+// address order. Each Page has its own free blocks: BitmapPageChain returns each 
+// block to its Page (through the address masking of its BasicPageTable), and keeps 
+// the Pages with free blocks listed (see getNextAvailPage()).
+// The same interface as the other Pages, except for the free lists; the Pages whose 
+// blocks are all free are found without walking any blocks. Not colored (see 
+// PageGrowth::nPageColors): the bitmap takes the start of the Page.
+//________________________________________________________________________________________
+template <>
+class alignas(cnMaxAlign) BasicPage<BitmapPageHeader> 
+  : public BasicPageList<BasicPage<BitmapPageHeader>>
+{
+  BitmapPageHeader header_;
+
+public:
+  size_t getBlockSize();
+  size_t getPageShift();
+  size_t getByteSize(); // Including the header and bitmap
+  size_t getBlockCount();
+  size_t getLiveBlockCount(); // Exact
+  BasicPage* getNextPage();
+  void setNextPage(BasicPage* page); // Relinks the Page list only
+  size_t countUntouchedBlocks(); // Past the highest block ever taken
+  BasicPage* getNextAvailPage();
+  void setNextAvailPage(BasicPage* page);
+
+  bool hasFreeBlocks(); 
+  void* takeBlock(); // Fails (nullptr) if none
+  void* tryTakeBlock(size_t nBlockSize); // Same; nBlockSize as of the chain
+  void returnBlock(void* block);
+  bool isLiveBlock(const void* block);
+  template <typename Function> void forEachLiveBlock(Function function); // (void*)
+
+  void initialize(size_t nBlockSize, 
+                  size_t nPageShift, 
+                  BasicPage* pagesSoFar,
+                  size_t nPageColors = 1); // Ignored
+
+  static size_t calcFirstPageShift(size_t nBlockSize); // Fitting a few blocks
+  static size_t calcBlockCount(size_t nBlockSize, size_t nPageShift);
+  static size_t calcFirstBlockOffset(size_t nBlockSize, size_t nPageShift);
+  // (See also BasicPageList):
+  static BasicPage* reclaimFreePages(BasicPage* pFirstPage, 
+                                     BasicPageTable<BasicPage>* pTable, // nullptr: 1 Page
+                                     size_t* pnReclaimedBlocks,
+                                     const BackendAllocator* backend = theBackendAllocator);
+  static BasicPage* alignDown(const void* block, size_t nPageShift); // Page of that size
+  size_t countFreeBlocks();
+
+private:
+  uint64_t* getBitmap();
+  size_t getWordCount();
+  size_t getBlockIndex(const void* block);
+  static size_t calcLayout(size_t nBlockSize, size_t nPageShift, size_t* pnFirstOffset);
 };
 
-inline bool PageHandle::isSingleInList() const
+inline size_t BitmapPage::getBlockSize()
 {
-  return pNext_ == this;
+  return header_.nBlockSize_;
 }
 
-inline void PageHandle::addSelfToList(PageHandle* where)
+inline size_t BitmapPage::getPageShift()
 {
-  assert (where && this != where);
+  return header_.nPageShift_;
+}
 
-  pPage_ = where->pPage_;
-  pNext_ = where->pNext_;
-  where->pNext_ = this;
+inline size_t BitmapPage::getByteSize()
+{
+  return size_t(1) << header_.nPageShift_;
 }
 
-inline void PageHandle::removeSelfFromList()
+inline size_t BitmapPage::getBlockCount()
 {
-  assert (!isSingleInList());
+  return header_.nBlockCount_;
+}
 
-  PageHandle* prev = findPrevInList();
-  prev->pNext_ = pNext_;
-  pNext_ = this;
-  pPage_ = nullptr;
+inline size_t BitmapPage::getLiveBlockCount()
+{
+  return header_.nLiveBlocks_;
 }
 
-inline Page* PageHandle::getOrCreatePage(size_t nUserBlockSize, bool needFreeBlock)
+inline BitmapPage* BitmapPage::getNextPage()
 {
-  if (!needFreeBlock)
-    return pPage_;
+  return (BitmapPage*) header_.pNextPage_;
+}
+
+inline void BitmapPage::setNextPage(BitmapPage* page)
+{
+  header_.pNextPage_ = page;
+}
+
+inline size_t BitmapPage::countUntouchedBlocks()
+{
+  return header_.nBlockCount_ - header_.nTouchedBlocks_;
+}
+
+inline BitmapPage* BitmapPage::getNextAvailPage()
+{
+  return (BitmapPage*) header_.pNextAvailPage_;
+}
+
+inline void BitmapPage::setNextAvailPage(BitmapPage* page)
+{
+  header_.pNextAvailPage_ = page;
+}
+
+inline BitmapPage* BitmapPage::alignDown(const void* block, size_t nPageShift)
+{
+  return (BitmapPage*) (size_t(block) & ~((size_t(1) << nPageShift) - 1));
+}
+
+inline uint64_t* BitmapPage::getBitmap()
+{
+  return (uint64_t*) (this + 1);
+}
+
+inline size_t BitmapPage::getWordCount()
+{
+  return (header_.nBlockCount_ + 63) / 64;
+}
+
+inline size_t BitmapPage::getBlockIndex(const void* block)
+{
+  size_t nOffset = (const char*) block - (const char*) this - header_.nFirstBlockOffset_;
+  assert ((const char*) block >= (const char*) this + header_.nFirstBlockOffset_ && 
+          nOffset % getBlockSize() == 0 && nOffset / getBlockSize() < getBlockCount());
+  return nOffset / getBlockSize();
+}
+
+inline bool BitmapPage::hasFreeBlocks()
+{
+  return header_.nLiveBlocks_ < header_.nBlockCount_;
+}
+
+inline void* BitmapPage::takeBlock()
+{
+  return tryTakeBlock(getBlockSize());
+}
 
-  if (!pPage_ || !pPage_->hasFreeBlocks())
+inline void* BitmapPage::tryTakeBlock(size_t nBlockSize)
+{
+  assert (nBlockSize == getBlockSize());
+  if (!hasFreeBlocks())
+    return nullptr;
+  uint64_t* bitmap = getBitmap();
+  size_t nWord = findNonZeroWord(bitmap, header_.nFirstFreeWord_, getWordCount());
+  assert (nWord < getWordCount());
+  size_t nBit = findFirstSetBit(bitmap[nWord]);
+  bitmap[nWord] &= bitmap[nWord] - 1; // Clears the lowest set bit
+  header_.nFirstFreeWord_ = uint32_t(nWord);
+  ++header_.nLiveBlocks_;
+  size_t nIndex = nWord * 64 + nBit;
+  if (nIndex >= header_.nTouchedBlocks_)
+    header_.nTouchedBlocks_ = uint32_t(nIndex + 1);
+  return (char*) this + header_.nFirstBlockOffset_ + nIndex * nBlockSize;
+}
+
+inline void BitmapPage::returnBlock(void* block)
+{
+  size_t nIndex = getBlockIndex(block),
+         nWord = nIndex / 64;
+  assert (isLiveBlock(block) && header_.nLiveBlocks_ > 0);
+  getBitmap()[nWord] |= uint64_t(1) << (nIndex % 64);
+  --header_.nLiveBlocks_;
+  if (nWord < header_.nFirstFreeWord_)
+    header_.nFirstFreeWord_ = uint32_t(nWord);
+}
+
+inline bool BitmapPage::isLiveBlock(const void* block)
+{
+  size_t nIndex = getBlockIndex(block);
+  return (getBitmap()[nIndex / 64] & (uint64_t(1) << (nIndex % 64))) == 0;
+}
+
+//========================================================================================
+// In address order. The bits past the last block are never set, so they read as live.
+//________________________________________________________________________________________
+template <typename Function>
+inline void BitmapPage::forEachLiveBlock(Function function)
+{
+  const uint64_t* bitmap = getBitmap();
+  char* pFirstBlock = (char*) this + header_.nFirstBlockOffset_;
+  size_t nBlockSize = getBlockSize(),
+         nBlockCount = getBlockCount();
+  for (size_t w = 0; w < getWordCount(); ++w)
+    for (uint64_t nLive = ~bitmap[w]; nLive; nLive &= nLive - 1)
+    {
+      size_t nIndex = w * 64 + findFirstSetBit(nLive);
+      if (nIndex < nBlockCount)
+        function((void*) (pFirstBlock + nIndex * nBlockSize));
+    }
+}
+
+inline size_t BitmapPage::countFreeBlocks()
+{
+  return getBlockCount() - getLiveBlockCount();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PageCache ////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// Per-thread cache of retired Pages, shared by all the allocator cliques of the thread.
+// The Pages of a deleted chain are kept here, listed by page shift, and handed out 
+// first to the new Pages of the same size and backend, so that short-lived containers
+// don't reach the backend at all. The cached bytes are capped by getCapacity() 
+// (0 disables caching); the Pages beyond it go back to the backend, as do all cached 
+// Pages upon thread exit.
+// Once a thread's cache is destroyed, get() returns nullptr and Pages go directly to 
+// the backend (e.g. for allocators with static storage duration).
+//________________________________________________________________________________________
+class PageCache
+{
+  struct CachedPage // Overlays the Page memory
+  {
+    CachedPage* pNext_;
+    const BackendAllocator* pBackend_;
+  };
+
+  CachedPage* apPages_[cnMaxHugePageShift_ + 1] = {}; // By page shift
+  size_t nBytes_ = 0;
+
+  static thread_local bool bDestroyed_;
+  static std::atomic<size_t> nCapacity_;
+
+public:
+  ~PageCache();
+
+  static PageCache* get(); // Of the calling thread; nullptr once destroyed
+  static size_t getCapacity();
+  static void setCapacity(size_t nBytes); // For all threads
+  static const size_t cnDefaultCapacity = 4*1024*1024;
+
+  void* takePage(size_t nPageShift, const BackendAllocator* backend); // Or nullptr
+  bool returnPage(void* page, size_t nPageShift, const BackendAllocator* backend);
+  size_t getByteSize() const { return nBytes_; }
+  void releaseAll(); // To the backends
+
+  // Through the calling thread's cache, if any, or the backend:
+  static void* allocatePage(size_t nPageShift, const BackendAllocator* backend);
+  static void deallocatePage(void* page, 
+                             size_t nPageShift, 
+                             const BackendAllocator* backend);
+};
+
+inline PageCache* PageCache::get()
+{
+  if (bDestroyed_)
+    return nullptr;
+  static thread_local struct Holder
   {
-    pPage_ = Page::addNewPage(nUserBlockSize, pPage_);
-    // Set all buddies' .pPage_ to the newly-created one:
-    for (auto h = pNext_; h != this; h = h->pNext_)
-      h->pPage_ = pPage_;
+    PageCache cache_;
+    ~Holder() { bDestroyed_ = true; }
+  } holder;
+  return &holder.cache_;
+}
+
+inline size_t PageCache::getCapacity()
+{
+  return nCapacity_.load(std::memory_order_relaxed);
+}
+
+inline void PageCache::setCapacity(size_t nBytes)
+{
+  nCapacity_.store(nBytes, std::memory_order_relaxed);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PageTable ////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// Finds the Page of any block of a PageChain in constant time.
+// Pages are aligned to their byte size, so masking a block address with the size of its 
+// Page yields the Page. Page sizes double up to 2^nMaxPageShift_ (the backend's), so 
+// a chain has at most one Page of each smaller size; these are kept here, by page 
+// shift. A block matching none of them belongs to a Page of the maximal size.
+// Of any Page layout (PageT); PageTable is that of Page.
+//________________________________________________________________________________________
+template <typename PageT>
+class BasicPageTable
+{
+  PageT* apSmallPages_[cnMaxHugePageShift_ - cnMinPageShift_] = {};
+  size_t nMaxPageShift_;
+
+public:
+  explicit BasicPageTable(size_t nMaxPageShift = cnMaxPageShift_);
+  void addPage(PageT* page);
+  void removePage(PageT* page);
+  PageT* findPage(const void* block);
+};
+
+template <typename PageT>
+inline BasicPageTable<PageT>::BasicPageTable(size_t nMaxPageShift)
+  : nMaxPageShift_(nMaxPageShift)
+{
+  assert (nMaxPageShift >= cnMinPageShift_ && nMaxPageShift <= cnMaxHugePageShift_);
+}
+
+template <typename PageT>
+inline PageT* BasicPageTable<PageT>::findPage(const void* block)
+{
+  for (size_t j = 0; j < nMaxPageShift_ - cnMinPageShift_; ++j)
+    if (PageT* p = apSmallPages_[j])
+      if (PageT::alignDown(block, j + cnMinPageShift_) == p)
+        return p;
+  return PageT::alignDown(block, nMaxPageShift_);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PageChain ////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// How the Pages of a PagePool grow, and lay their blocks out; set per allocator type 
+// (see AllocatorTraits in PrivateAllocator.h). The shifts are log2 of byte sizes.
+// Cache-line blocks: block sizes below cnCacheLineSize are rounded up to a power of 2,
+// so that no block straddles two cache lines (e.g. 24-byte list nodes take 32 bytes).
+// Page colors: the Pages of a few KB or more are all aligned alike, so the first blocks
+// of all of them compete for the same cache sets. With n colors, the blocks of each 
+// Page start 0 to n-1 cache lines (or block alignments, if larger) further, by the 
+// Page address. Pages are only colored while that costs at most 1/8 of their bytes.
+// Adaptive first Page: fitting the typical final size of the earlier chains of the 
+// same block size (see ChainSizeHistory), if larger than nFirstPageShift.
+//________________________________________________________________________________________
+struct PageGrowth
+{
+  size_t nFirstPageShift = 0; // 0: the smallest Page fitting a few blocks
+  size_t nGrowthShift = 1;    // Each next Page is 2^nGrowthShift times larger
+  size_t nMaxPageShift = 0;   // 0: the backend's largest (see BackendAllocator)
+  bool bCacheLineBlocks = false;
+  size_t nPageColors = 1;     // A power of 2, up to cnMaxPageColors_; 1: no coloring
+  bool bAdaptiveFirstPage = false;
+};
+
+//****************************************************************************************
+// Running statistics of the final sizes of the PageChains with adaptive first Pages, 
+// per block size: recorded as their Pages are deleted (i.e. upon the destruction of
+// their clique), as the blocks ever taken - those carved out of the Pages.
+// The typical size is a moving average of log2 of the sizes, with a weight of 1/8 for 
+// the latest one, so that a few outliers don't inflate the first Pages of all chains.
+// Process-wide, with relaxed atomics: concurrent updates may get lost, which is fine
+// for a hint.
+//________________________________________________________________________________________
+class ChainSizeHistory
+{
+  static const size_t cnEntryCount = cnMaxBlockSize_ / cnMinAlign;
+  static const uint32_t cnScale = 64; // Of the fixed-point log2 averages
+
+  // (1 + the average) * cnScale; 0 while there's no record:
+  static std::atomic<uint32_t> anAverages_[cnEntryCount];
+
+public:
+  static void record(size_t nBlockSize, size_t nBlocks);
+  static size_t getTypicalBlockCount(size_t nBlockSize); // A power of 2; 0 if unknown
+  static void clear(size_t nBlockSize);
+
+private:
+  static std::atomic<uint32_t>& getAverage(size_t nBlockSize);
+};
+
+inline std::atomic<uint32_t>& ChainSizeHistory::getAverage(size_t nBlockSize)
+{
+  assert (nBlockSize > 0 && nBlockSize <= cnMaxBlockSize_);
+  return anAverages_[(nBlockSize - 1) / cnMinAlign];
+}
+
+//****************************************************************************************
+// The chain of Pages serving a single block size: what doesn't depend on the Page 
+// layout (PageT), i.e. the Page list, its growth and its statistics. PageChain and 
+// BitmapPageChain add the handling of the free blocks.
+// pPage_ is the most recently created Page; it heads the Page list (through 
+// getNextPage()).
+// Counts the blocks in order to reclaim the fully-free Pages once the free blocks 
+// exceed nTrimThreshold_ (in bytes; 0 disables it), or upon explicit trim().
+// The PageTable is created along with the second Page.
+// nPageShift_ is the size of the newest Page, so that the next size is found without
+// touching any Page. It only grows, except when trim() frees the whole chain.
+// The Page sizes follow setGrowth() - by default from the smallest (or, if adaptive, 
+// one for the typical final size), doubling, up to cnMaxPageShift_. reserve() adds 
+// Pages large enough for a number of blocks at once.
+// addNewPage() is createPage() (sized and counted) followed by linkPage() (in front of
+// the Page list, and in the PageTable); a chain may keep Pages in between.
+//________________________________________________________________________________________
+template <typename PageT>
+struct BasicPageChain
+{
+  typedef PageT PageType;
+
+  PageT* pPage_ = nullptr;          // Delay-created
+  size_t nBlockSize_ = 0;           // 0 while the chain is unused
+  BasicPageTable<PageT>* pPageTable_ = nullptr; // Delay-created
+  size_t nPageShift_ = 0;           // 0 while there are no Pages
+
+  size_t nBlockCount_ = 0;          // In all Pages
+  size_t nLiveBlocks_ = 0;          // Taken and not returned yet
+  size_t nTrimThreshold_ = 0;       
+  size_t nTrimAt_ = 0;              // Free block count triggering automatic trim()
+  size_t nSortThreshold_ = 0;
+  size_t nReturnsToSort_ = 0;       // Until the automatic sortFreeBlocks()
+  const BackendAllocator* pBackend_ = theBackendAllocator; // Of the Pages
+  StatsCounters<size_t>* pStats_ = nullptr; // Of the PagePool, if any
+  size_t nFirstPageShift_ = 0;      // 0: PageT::calcFirstPageShift()
+  size_t nGrowthShift_ = 1;
+  size_t nMaxPageShift_ = cnMaxPageShift_;
+  size_t nPageColors_ = 1;
+  bool bAdaptiveFirstPage_ = false;
+
+  void trim();
+  void setTrimThreshold(size_t nFreeBytes);
+  void setSortThreshold(size_t nReturns);
+  void setGrowth(const PageGrowth& growth); // Once nBlockSize_ and pBackend_ are set
+
+  PageT* findPage(const void* block);
+  void addNewPage(size_t nMinBlockCount = 0); // Larger than the next size, if needed
+  PageT* createPage(size_t nMinBlockCount); // Same, not linked
+  void linkPage(PageT* page); // A created one, with no free blocks before it
+  void deleteAllPages(); // And the PageTable; recorded in ChainSizeHistory, if adaptive
+};
+
+template <typename PageT>
+inline PageT* BasicPageChain<PageT>::findPage(const void* block)
+{
+  assert (pPage_);
+  return pPageTable_ ? pPageTable_->findPage(block) : pPage_;
+}
+
+//****************************************************************************************
+// The chain of Pages (with free lists) serving a single block size.
+// pPage_ heads both the Page list and the free-block list shared by all Pages in the 
+// chain.
+// sortFreeBlocks() restores the locality of the free list; now, or automatically, once
+// per nSortThreshold_ returned blocks (0 disables it). Each sort walks all the free 
+// blocks, so thresholds of about their count keep that amortized O(1) per block.
+// Only the first Page carves its untouched blocks, so the extra Pages of reserve() 
+// wait in pReservedPages_, untouched (and unlinked from the Page list and PageTable), 
+// until the first Page runs out of blocks; they count as free blocks meanwhile.
+//________________________________________________________________________________________
+struct PageChain : BasicPageChain<Page>
+{
+  PageChain* pNextChain_ = nullptr; // Other block sizes of the same PagePool
+  Page* pReservedPages_ = nullptr;  // Linked through getNextPage()
+
+  bool hasFreeBlocks();
+  void* tryTakeBlock(); // nullptr rather than adding a Page
+  void* takeBlock();
+  void returnBlock(void* block);
+
+  void sortFreeBlocks();
+  void reserve(size_t nFreeBlocks); // Make at least that many blocks free
+  void trim();
+  void addNewPage(); // A reserved one, if any
+  void deleteAllPages();
+
+private:
+  void deleteReservedPages(bool bTrim); // To the backend if trimming, else PageCache
+};
+
+inline void* PageChain::tryTakeBlock()
+{
+  void* b = pPage_ ? pPage_->tryTakeBlock(nBlockSize_) : nullptr;
+  if (b)
+    ++nLiveBlocks_;
+  return b;
+}
+
+inline void* PageChain::takeBlock()
+{
+  if (void* b = tryTakeBlock())
+    return b;
+  addNewPage();
+  ++nLiveBlocks_;
+  return pPage_->takeBlock();
+}
+
+inline bool PageChain::hasFreeBlocks()
+{
+  return pPage_ && pPage_->hasFreeBlocks();
+}
+
+inline void PageChain::returnBlock(void* block)
+{
+  assert (pPage_ && nLiveBlocks_ > 0); // Should have been there during takeBlock()
+  pPage_->returnBlock(block);
+  --nLiveBlocks_;
+  if (nTrimThreshold_ && nBlockCount_ - nLiveBlocks_ >= nTrimAt_)
+    trim();
+  if (nSortThreshold_ && --nReturnsToSort_ == 0)
+    sortFreeBlocks();
+}
+
+//****************************************************************************************
+// The chain of BitmapPages serving a single block size.
+// Each Page keeps its own free blocks: a block is returned to its Page, found through 
+// the PageTable (or, with a single Page, pPage_). The Pages with free blocks are 
+// linked (through BitmapPage::getNextAvailPage()) from pAvailPage_, which serves the 
+// blocks - the lowest free one first - until it is full; a Page rejoins the list when a
+// block of it is returned while it is full. A new Page is only added when the list is
+// empty.
+// The blocks are never out of address order within a Page, so sortFreeBlocks() and 
+// the sort threshold have nothing to do.
+//________________________________________________________________________________________
+struct BitmapPageChain : BasicPageChain<BitmapPage>
+{
+  BitmapPageChain* pNextChain_ = nullptr; // Other block sizes of the same pool
+  BitmapPage* pAvailPage_ = nullptr;      // The Pages with free blocks
+
+  bool hasFreeBlocks();
+  void* tryTakeBlock(); // nullptr rather than adding a Page
+  void* takeBlock();
+  void returnBlock(void* block);
+
+  void trim();
+  void sortFreeBlocks() {}
+  void reserve(size_t nFreeBlocks); // Make at least that many blocks free
+  void deleteAllPages();
+
+private:
+  void addAvailPage(); // A new one
+  void relinkAvailPages();
+};
+
+inline bool BitmapPageChain::hasFreeBlocks()
+{
+  return pAvailPage_ != nullptr;
+}
+
+inline void* BitmapPageChain::tryTakeBlock()
+{
+  BitmapPage* p = pAvailPage_;
+  if (!p)
+    return nullptr;
+  void* b = p->tryTakeBlock(nBlockSize_);
+  assert (b);
+  if (!p->hasFreeBlocks())
+    pAvailPage_ = p->getNextAvailPage();
+  ++nLiveBlocks_;
+  return b;
+}
+
+inline void* BitmapPageChain::takeBlock()
+{
+  if (!pAvailPage_)
+    addAvailPage();
+  return tryTakeBlock();
+}
+
+inline void BitmapPageChain::returnBlock(void* block)
+{
+  assert (pPage_ && nLiveBlocks_ > 0); // Should have been there during takeBlock()
+  BitmapPage* p = findPage(block);
+  if (!p->hasFreeBlocks())
+  {
+    p->setNextAvailPage(pAvailPage_);
+    pAvailPage_ = p;
   }
-  assert (pPage_ && pPage_->getBlockSize() >= nUserBlockSize);
-  return pPage_;
+  p->returnBlock(block);
+  --nLiveBlocks_;
+  if (nTrimThreshold_ && nBlockCount_ - nLiveBlocks_ >= nTrimAt_)
+    trim();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// ArrayCache ///////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// Freed arrays (vector buffers, hash bucket arrays etc), kept for reuse.
+// Arrays are allocated with byte sizes rounded up to a power of 2, and are kept in 
+// a separate free list per size, linked through their first bytes.
+//________________________________________________________________________________________
+class ArrayCache
+{
+public:
+  // log2 of the byte size of the smallest and the largest cached arrays
+  static const size_t cnMinSizeClass = 4;
+  static const size_t cnMaxSizeClass = 20;
+
+  static_assert(size_t(1) << cnMaxSizeClass == cnMaxCachedArrayByteSize_, 
+                "cnMaxSizeClass and cnMaxCachedArrayByteSize_ mismatch");
+
+  static size_t calcSizeClass(size_t nByteSize); // log2 of the rounded-up size
+
+  void* takeArray(size_t nByteSize);             // always succeeds
+  void returnArray(void* array, size_t nByteSize);
+  void releaseAll();                             // to the backend
+
+  const BackendAllocator* pBackend_ = theBackendAllocator; // Of the arrays
+
+private:
+  FreeBlock* apFreeArrays_[cnMaxSizeClass + 1] = {};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////// RemoteFreeLists /////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// Blocks deallocated by threads other than the PagePool owner; a list per block size.
+// Multiple producers push with a single CAS each; the (single) owner takes a whole 
+// list at once, by exchange, so there is no ABA problem.
+//________________________________________________________________________________________
+class RemoteFreeLists
+{
+  static const size_t cnListCount = cnMaxBlockSize_ / cnMinAlign;
+
+  std::atomic<FreeBlock*> apLists_[cnListCount];
+
+public:
+  RemoteFreeLists();
+
+  void push(void* block, size_t nBlockSize);  // Thread-safe
+  FreeBlock* takeAll(size_t nBlockSize);      // Thread-safe; nullptr-terminated list
+
+private:
+  std::atomic<FreeBlock*>& getList(size_t nBlockSize);
+};
+
+inline std::atomic<FreeBlock*>& RemoteFreeLists::getList(size_t nBlockSize)
+{
+  assert (nBlockSize > 0 && nBlockSize <= cnMaxBlockSize_);
+  return apLists_[(nBlockSize - 1) / cnMinAlign];
+}
+
+inline void RemoteFreeLists::push(void* block, size_t nBlockSize)
+{
+  auto b = (FreeBlock*) block;
+  std::atomic<FreeBlock*>& list = getList(nBlockSize);
+  b->pNextBlock_ = list.load(std::memory_order_relaxed);
+  while (!list.compare_exchange_weak(b->pNextBlock_, 
+                                     b, 
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed))
+    ;
+}
+
+inline FreeBlock* RemoteFreeLists::takeAll(size_t nBlockSize)
+{
+  std::atomic<FreeBlock*>& list = getList(nBlockSize);
+  if (!list.load(std::memory_order_relaxed))
+    return nullptr;
+  return list.exchange(nullptr, std::memory_order_acquire);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PagePool /////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// The Page allocation state shared by a clique of PrivateAllocator<>s (i.e. all 
+// copies and rebound copies of the same allocator).
+// Keeps a separate Chain per block size (user sizes rounded; see calcBlockSize()), so 
+// that each rebound type up to cnMaxBlockSize_ gets its own pool of blocks. The Chain 
+// sets the Page layout: PageChain for PagePool, BitmapPageChain for BitmapPagePool.
+// Chains are kept in a short list; the first one is embedded, since most cliques 
+// (e.g. node-based containers) only use a single block size.
+// Also keeps the (delay-created) ArrayCache for all other allocations.
+// The pool is owned by the first thread that allocates from it (not necessarily the 
+// one that created it, e.g. with a container constructed for a worker thread); until 
+// then, any thread acts as the owner. Other threads may only deallocate (e.g. erase 
+// nodes of a container handed over to them): their blocks go to the (delay-created) 
+// RemoteFreeLists, drained by the owner when a chain runs out of free blocks, and by
+// trim(), sortFreeBlocks() and getStats() on the owner thread (so that such blocks 
+// count as free there); their arrays go straight to the backend.
+// The Pages and arrays come from the backend given to create(); the bookkeeping 
+// structures (the pool itself, PageTables etc.) always come from theBackendAllocator.
+// Reference-counted by the PageHandles of the clique, atomically: a clique member may 
+// be destroyed by another thread (e.g. with a container handed over to it).
+//________________________________________________________________________________________
+template <typename Chain>
+class BasicPagePool
+{
+  Chain firstChain_; 
+  std::atomic<size_t> nRefCount_{1};
+  ArrayCache* pArrayCache_ = nullptr;
+  size_t nTrimThreshold_ = 0; // For the chains to come
+  size_t nSortThreshold_ = 0; // Same
+  bool bFallbacks_ = false;   // Any so far; these are not in the Pages
+  bool bReleaseAll_ = false;  // Set by releaseAllAtOnce(): returnBlock() does nothing
+  std::atomic<const void*> pOwnerThread_{nullptr}; // The first allocating thread
+  std::atomic<RemoteFreeLists*> pRemoteFrees_{nullptr};
+  const BackendAllocator* pBackend_ = theBackendAllocator; // Of the Pages and arrays
+  StatsCounters<size_t> stats_;
+  PageGrowth growth_; // Of all chains
+
+public:
+  static BasicPagePool* create(const BackendAllocator* backend = theBackendAllocator,
+                               const PageGrowth& growth = PageGrowth());
+  static void destroy(BasicPagePool* pool); // Deletes all Pages too
+  void addRef();
+  static void release(BasicPagePool* pool); // destroy()s it upon the last release
+  size_t getRefCount() const;
+  // Wink-out: with 'nRefCount' references (all to go along with the live blocks), on
+  // the owner thread, and with all the allocations in the Pages, returnBlock() does
+  // nothing from now on - the Pages go, blocks and all, at the last release(). 
+  // Otherwise does nothing and returns false:
+  bool releaseAllAtOnce(size_t nRefCount);
+
+  void* takeBlock(size_t nUserSize);
+  void returnBlock(void* block, size_t nUserSize);
+
+  size_t calcBlockSize(size_t nUserSize) const; // Of the chain serving that size
+  Chain* findChain(size_t nUserSize);
+  Chain* getOrCreateChain(size_t nUserSize);
+
+  // Reclaim fully-free Pages of all chains; now, or automatically (see PageChain):
+  void trim();
+  void setTrimThreshold(size_t nFreeBytes);
+  void reserve(size_t nBlocks, size_t nUserSize); // Free blocks of that size
+  // For each block size, as many free blocks as 'model' has live ones, up to nMaxBlocks:
+  void reserveLike(BasicPagePool* model, size_t nMaxBlocks);
+  // Relink the free blocks of all chains in address order; now, or automatically:
+  void sortFreeBlocks();
+  void setSortThreshold(size_t nReturns);
+
+  // Non-Page (arrays, large blocks) allocations, served by the ArrayCache when small:
+  void* allocateArray(size_t nByteSize);
+  void deallocateArray(void* array, size_t nByteSize);
+  void addFallback(); // Counts a non-Page allocation; allocateArray() does it too
+
+  AllocatorStats getStats();
+
+  bool isOwnerThread() const;
+  static const void* getThreadId();
+
+private:
+  void claimOwnerThread(); // Unless owned already
+  Chain* addNewChain(size_t nBlockSize);
+  void returnRemoteBlock(void* block, size_t nBlockSize);
+  void drainRemoteBlocks(Chain* c);
+  void drainAllRemoteBlocks(); // Of all chains, if on the owner thread
+};
+
+typedef BasicPagePool<PageChain> PagePool;             // Of the allocators, by default
+typedef BasicPagePool<BitmapPageChain> BitmapPagePool; // Selected by AllocatorTraits
+
+// Cheaper than std::this_thread::get_id(): an address unique among the running threads.
+template <typename Chain>
+inline const void* BasicPagePool<Chain>::getThreadId()
+{
+  static thread_local char threadMarker;
+  return &threadMarker;
+}
+
+template <typename Chain>
+inline void BasicPagePool<Chain>::addRef()
+{
+  nRefCount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Chain>
+inline void BasicPagePool<Chain>::release(BasicPagePool* pool)
+{
+  assert (pool && pool->nRefCount_.load(std::memory_order_relaxed) > 0);
+  if (pool->nRefCount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    destroy(pool);
+}
+
+template <typename Chain>
+inline size_t BasicPagePool<Chain>::getRefCount() const
+{
+  return nRefCount_.load(std::memory_order_relaxed);
+}
+
+template <typename Chain>
+inline bool BasicPagePool<Chain>::isOwnerThread() const
+{
+  const void* pOwner = pOwnerThread_.load(std::memory_order_relaxed);
+  return !pOwner || pOwner == getThreadId();
+}
+
+// Relaxed: the other threads only get blocks (hence look at the owner) after some
+// synchronization with the allocating thread.
+template <typename Chain>
+inline void BasicPagePool<Chain>::claimOwnerThread()
+{
+  if (!pOwnerThread_.load(std::memory_order_relaxed))
+    pOwnerThread_.store(getThreadId(), std::memory_order_relaxed);
+}
+
+template <typename Chain>
+inline bool BasicPagePool<Chain>::releaseAllAtOnce(size_t nRefCount)
+{
+  if (getRefCount() != nRefCount || bFallbacks_ || !isOwnerThread())
+    return false;
+  bReleaseAll_ = true;
+  return true;
+}
+
+//========================================================================================
+// cnMinAlign multiples; with cache-line blocks, the sizes below a cache line are
+// rounded up to (power of 2) divisors of it.
+//________________________________________________________________________________________
+template <typename Chain>
+inline size_t BasicPagePool<Chain>::calcBlockSize(size_t nUserSize) const
+{
+  size_t nBlockSize = roundUp(nUserSize, cnMinAlign);
+  if (growth_.bCacheLineBlocks)
+    while (nBlockSize < cnCacheLineSize && (nBlockSize & (nBlockSize - 1)) != 0)
+      nBlockSize += nBlockSize & (0 - nBlockSize);
+  return nBlockSize;
+}
+
+template <typename Chain>
+inline Chain* BasicPagePool<Chain>::findChain(size_t nUserSize)
+{
+  size_t nBlockSize = calcBlockSize(nUserSize);
+  for (Chain* c = &firstChain_; c; c = c->pNextChain_)
+    if (c->nBlockSize_ == nBlockSize)
+      return c;
+  return nullptr;
+}
+
+template <typename Chain>
+inline Chain* BasicPagePool<Chain>::getOrCreateChain(size_t nUserSize)
+{
+  if (Chain* c = findChain(nUserSize))
+    return c;
+  return addNewChain(calcBlockSize(nUserSize));
+}
+
+template <typename Chain>
+inline void* BasicPagePool<Chain>::takeBlock(size_t nUserSize)
+{
+  Chain* c = getOrCreateChain(nUserSize);
+  if (void* b = c->tryTakeBlock())
+    return b;
+  if (pRemoteFrees_.load(std::memory_order_relaxed))
+    drainRemoteBlocks(c);
+  return c->takeBlock();
+}
+
+template <typename Chain>
+inline void BasicPagePool<Chain>::returnBlock(void* block, size_t nUserSize)
+{
+  if (!isOwnerThread())
+    return returnRemoteBlock(block, calcBlockSize(nUserSize));
+  if (bReleaseAll_)
+    return;
+
+  Chain* c = findChain(nUserSize);
+  assert (c); // Should have been there during takeBlock()
+  c->returnBlock(block);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// PageHandle ///////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+
+//****************************************************************************************
+// The PagePool reference of an allocator: a single pointer, so that copying, 
+// destruction and comparison are O(1). The clique is the set of handles sharing the
+// (reference-counted) PagePool. A handle is in a clique of its own until the pool is 
+// created: on the first allocation, or once the handle is shared.
+// Embedded as data member in PrivateAllocator<>.
+//________________________________________________________________________________________
+template <typename Pool>
+struct BasicPageHandle 
+{
+// Data
+  Pool* pPool_ = nullptr; // Delay-created
+
+// Ctors, dtor
+  BasicPageHandle() = default;
+  ~BasicPageHandle() { release(); }
+  
+  BasicPageHandle(const BasicPageHandle&) = delete;
+  BasicPageHandle& operator=(const BasicPageHandle&) = delete;
+
+// Clique management
+  void share(Pool* pool);     // Join the clique of 'pool'; this must have none
+  void release();             // And become single again
+  void swap(BasicPageHandle& other); // Exchange the cliques; no reference count changes
+  bool inSameClique(const BasicPageHandle* ph) const;
+
+// Pool access and creation 
+  Pool* getOrCreatePool(const BackendAllocator* backend = theBackendAllocator,
+                        const PageGrowth& growth = PageGrowth());
+};
+
+typedef BasicPageHandle<PagePool> PageHandle;
+
+template <typename Pool>
+inline void BasicPageHandle<Pool>::share(Pool* pool)
+{
+  assert (pool && !pPool_);
+  pool->addRef();
+  pPool_ = pool;
+}
+
+template <typename Pool>
+inline void BasicPageHandle<Pool>::release()
+{
+  if (pPool_)
+    Pool::release(pPool_);
+  pPool_ = nullptr;
+}
+
+template <typename Pool>
+inline void BasicPageHandle<Pool>::swap(BasicPageHandle& other)
+{
+  std::swap(pPool_, other.pPool_);
+}
+
+template <typename Pool>
+inline bool BasicPageHandle<Pool>::inSameClique(const BasicPageHandle* ph) const
+{
+  return pPool_ ? pPool_ == ph->pPool_ : this == ph;
+}
+
+template <typename Pool>
+inline Pool* BasicPageHandle<Pool>::getOrCreatePool(const BackendAllocator* backend,
+                                                    const PageGrowth&       growth)
+{
+  if (!pPool_)
+    pPool_ = Pool::create(backend, growth);
+  return pPool_;
 }
 
 // -------------------------------- End Of File ------------------------------------------
@@ -23,6 +23,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <thread>
 
 // --------------------------- Definitions -------------------------------------
 
@@ -37,19 +38,21 @@ void test_PrivateAllocator()
   typedef PrivateAllocator<long> PAIL;
 
   PAI pai;
-  RG_EXPECT(!pai.paHandle_.pPage_);
+  auto pool = pai.paHandle_.pPool_;
+  RG_EXPECT(pool && pool->getRefCount() == 1);
   
-  auto block3 = pai.allocate(3); // Should invoke back-end allocator
-  RG_EXPECT(!pai.paHandle_.pPage_);
+  auto block3 = pai.allocate(3); // Should invoke the ArrayCache
+  RG_EXPECT(pai.paHandle_.pPool_ == pool && !pool->findChain(sizeof(int)));
   for (int j = 0; j < 3; ++j)
     block3[j] = j;
   RG_EXPECT(std::vector<int>({0,1,2}) == std::vector<int>(block3, block3 + 3))
   pai.deallocate(block3, 3);
+  RG_EXPECT(pai.allocate(4) == block3); // Recycled array of the same size class
+  pai.deallocate(block3, 4);
 
   auto block = pai.allocate(1);
   RG_EXPECT(block);
-  auto pa = pai.paHandle_.pPage_;
-  RG_EXPECT(pa);
+  RG_EXPECT(pai.paHandle_.pPool_ == pool && pool->findChain(sizeof(int)));
 
   *block = 17;
   pai.deallocate(block, 1);
@@ -60,15 +63,420 @@ void test_PrivateAllocator()
   RG_EXPECT(pai == cpy);
   PAI other;
   RG_EXPECT(pai != other)
+  other = cpy; // Joins the clique, as copies do
+  RG_EXPECT(other == pai && pool->getRefCount() == 3);
 
   PAIL pail(pai);
   RG_EXPECT(pail == pai)
   auto bl = pail.allocate(1);
   RG_EXPECT(bl)
+
+  // Rebound types of a larger size get their own PageChain in the same PagePool:
+  struct Big { char data[cnMaxBlockSize_]; };
+  PrivateAllocator<Big> pab(pai);
+  RG_EXPECT(pab == pai && pab.paHandle_.pPool_ == pool);
+  auto big = pab.allocate(1);
+  RG_EXPECT(big && pool->findChain(sizeof(Big)));
+  RG_EXPECT(pool->findChain(sizeof(Big)) != pool->findChain(sizeof(int)));
+  pab.deallocate(big, 1);
+  RG_EXPECT(pab.allocate(1) == big); // Reused from the free list
+
+  // Releasing the Pages of the blocks no longer used:
+  pab.deallocate(big, 1);
+  pab.trim();
+  RG_EXPECT(!pool->findChain(sizeof(Big))->pPage_);
+  RG_EXPECT(pool->findChain(sizeof(int))->pPage_); // 'block' still in use
+  pai.deallocate(block, 1);
+  pail.deallocate(bl, 1);
+  cpy.trim();
+  RG_EXPECT(!pool->findChain(sizeof(int))->pPage_);
+
+  // A list handed over to another thread, which erases its nodes:
+  typedef std::list<int, PAI> PAList;
+  PAList produced(pai);
+  for (int j = 0; j < 1000; ++j)
+    produced.push_back(j);
+  std::thread([&produced]()
+  {
+    PAList consumed(std::move(produced));
+    consumed.clear();
+  }).join();
+  PageChain* nodes = pool->findChain(sizeof(int) + 2 * sizeof(void*));
+  size_t nBlockCount = nodes ? nodes->nBlockCount_ : 0;
+  RG_EXPECT(produced.get_allocator() == pai); // Moved-from, still in the clique
+  produced.clear();
+  for (int j = 0; j < 1000; ++j)
+    produced.push_back(j); // Reuses the nodes erased remotely
+  RG_EXPECT(nodes && nodes->nBlockCount_ == nBlockCount);
+
+  // A list emptied by another thread; trim() and stats() here see its nodes as free, 
+  // with no allocation in between:
+  PAI owner;
+  PAList handed(owner);
+  for (int j = 0; j < 1000; ++j)
+    handed.push_back(j);
+  std::thread([&handed]()
+  {
+    PAList consumed(std::move(handed));
+    consumed.clear();
+  }).join();
+  RG_EXPECT(owner.stats().nLiveBlocks == 0);
+  owner.trim();
+  PageChain* handedNodes = 
+    owner.paHandle_.pPool_->findChain(sizeof(int) + 2 * sizeof(void*));
+  RG_EXPECT(handedNodes && !handedNodes->pPage_ && !handedNodes->nLiveBlocks_);
+
+  // A list constructed here, but used by another thread only, which owns its clique: 
+  // the nodes are freed locally, so trim() there releases all the Pages:
+  PAList deferred;
+  std::thread([&deferred]()
+  {
+    for (int j = 0; j < 100000; ++j)
+      deferred.push_back(j);
+    deferred.clear();
+    deferred.get_allocator().trim();
+  }).join();
+  PageChain* deferredNodes = 
+    deferred.get_allocator().paHandle_.pPool_->findChain(sizeof(int) + 2 * sizeof(void*));
+  RG_EXPECT(deferredNodes && !deferredNodes->pPage_ && !deferredNodes->nLiveBlocks_);
+
+  // A single pointer, to the pool created with the allocator; the pool outlives it:
+  static_assert(sizeof(PAI) == sizeof(void*), "PrivateAllocator: one pointer");
+  PAI* fresh = new PAI;
+  PAI survivor(*fresh);
+  RG_EXPECT(survivor == *fresh && survivor.paHandle_.pPool_);
+  delete fresh;
+  int* last = survivor.allocate(1);
+  RG_EXPECT(last);
+  survivor.deallocate(last, 1);
+
+  // Moves share the clique, as copies do (the moved-from stays equal); swaps exchange
+  // the clique memberships only:
+  PagePool* survivorPool = survivor.paHandle_.pPool_;
+  PAI moved(std::move(survivor));
+  RG_EXPECT(moved.paHandle_.pPool_ == survivorPool && survivor == moved);
+  PAI assigned;
+  assigned = std::move(moved);
+  RG_EXPECT(assigned == survivor && moved == survivor);
+  RG_EXPECT(survivorPool->getRefCount() == 3);
+  swap(survivor, cpy);
+  RG_EXPECT(survivor == pai && cpy.paHandle_.pPool_ == survivorPool);
 };
 
 RG_ADD_UNITTEST2(test_PrivateAllocator, 2)
 
+//========================================================================================
+// Statistics through the allocator, and of the thread
+//________________________________________________________________________________________
+void test_PrivateAllocatorStats()
+{
+  std::list<int, PrivateAllocator<int>> l;
+  RG_EXPECT(l.get_allocator().stats().nPages == 0);
+  AllocatorStats thread0 = getThreadStats();
+  for (int j = 0; j < 1000; ++j)
+    l.push_back(j);
+  std::vector<int, PrivateAllocator<int>> v(l.get_allocator());
+  v.reserve(cnMaxCachedArrayByteSize_); // Directly from the backend
+  v.reserve(10);
+
+  AllocatorStats stats = l.get_allocator().stats();
+  AllocatorStats thread = getThreadStats();
+  AllocatorStats process = getProcessStats();
+  #if RG_PRIVATEALLOCATOR_STATS
+    RG_EXPECT(stats.nLiveBlocks == 1000 && stats.nFreeBlocks < 1000);
+    RG_EXPECT(stats.nPages > 1 && stats.nPageBytes > 1000 * sizeof(int));
+    RG_EXPECT(stats.nPeakPageBytes == stats.nPageBytes && stats.nFallbacks == 1);
+    RG_EXPECT(thread.nFallbacks == thread0.nFallbacks + 1);
+    RG_EXPECT(thread.nPageBytes <= thread0.nPageBytes + stats.nPageBytes); // PageCache
+    RG_EXPECT(process.nFallbacks >= thread.nFallbacks && process.nPages > 0);
+
+    l.clear();
+    l.get_allocator().trim();
+    stats = l.get_allocator().stats();
+    RG_EXPECT(stats.nLiveBlocks == 0 && stats.nPages == 0 && stats.nPeakPageBytes > 0);
+  #else
+    RG_EXPECT(stats.nPages == 0 && thread.nPages == 0 && process.nFallbacks == 0);
+  #endif
+}
+
+RG_ADD_UNITTEST2(test_PrivateAllocatorStats, 2)
+
+//========================================================================================
+// Traits and reserve()
+//________________________________________________________________________________________
+struct SmallPageTraits : DefaultAllocatorTraits
+{
+  static const size_t cnMaxBlockSize = 32;
+  static const size_t cnMaxPageShift = 10;
+};
+
+struct CacheLineTraits : DefaultAllocatorTraits
+{
+  static const bool cbCacheLineBlocks = true;
+  static const size_t cnPageColors = 8;
+};
+
+struct AdaptiveTraits : DefaultAllocatorTraits
+{
+  static const bool cbAdaptiveFirstPage = true;
+};
+
+struct BitmapTraits : DefaultAllocatorTraits
+{
+  static const bool cbBitmapPages = true;
+};
+
+void test_AllocatorTraits()
+{
+  typedef PrivateAllocator<int, NewDeleteBackend, SmallPageTraits> SmallPA;
+  std::list<int, SmallPA> l;
+  std::set<int, std::less<int>, SmallPA> s(l.get_allocator()); // Nodes > 32 bytes
+  for (int j = 0; j < 1000; ++j)
+    l.push_back(j), s.insert(j);
+  PagePool* pool = l.get_allocator().paHandle_.pPool_;
+  PageChain* nodes = pool ? pool->findChain(sizeof(int) + 2 * sizeof(void*)) : nullptr;
+  RG_EXPECT(nodes && nodes->pPage_->getByteSize() == 1024 && nodes->nLiveBlocks_ == 1000);
+  RG_EXPECT(l.get_allocator().stats().nFallbacks >= 1000 || !RG_PRIVATEALLOCATOR_STATS);
+
+  // Pages for the final size, up-front:
+  std::list<long long, PrivateAllocator<long long>> r;
+  const size_t nNodeSize = sizeof(long long) + 2 * sizeof(void*);
+  r.get_allocator().reserve(100000, nNodeSize);
+  PageChain* reserved = r.get_allocator().paHandle_.pPool_->findChain(nNodeSize);
+  size_t nPages = Page::countPages(reserved->pPage_) + 
+                    Page::countPages(reserved->pReservedPages_);
+  RG_EXPECT(nPages <= 100000 * nNodeSize / cnMaxPageByteSize_ + 1);
+  for (int j = 0; j < 100000; ++j)
+    r.push_back(j);
+  RG_EXPECT(Page::countPages(reserved->pPage_) == nPages && !reserved->pReservedPages_);
+
+  // Nodes within cache lines, in colored Pages:
+  std::list<long long, PrivateAllocator<long long, NewDeleteBackend, CacheLineTraits>> c;
+  for (int j = 0; j < 100000; ++j)
+    c.push_back(j);
+  bool bWithinLines = true;
+  for (auto& item : c)
+    bWithinLines = bWithinLines && 
+                   size_t(&item) / cnCacheLineSize == 
+                     (size_t(&item + 1) - 1) / cnCacheLineSize;
+  PageChain* colored = c.get_allocator().paHandle_.pPool_->findChain(nNodeSize);
+  RG_EXPECT(bWithinLines && colored && colored->nBlockSize_ == 32);
+  RG_EXPECT(colored->nLiveBlocks_ == 100000);
+
+  // The first Page for the size of the earlier lists:
+  typedef PrivateAllocator<long long, NewDeleteBackend, AdaptiveTraits> AdaptivePA;
+  ChainSizeHistory::clear(nNodeSize);
+  size_t anPages[2] = {};
+  for (size_t& n : anPages)
+  {
+    std::list<long long, AdaptivePA> a(3000, 1);
+    n = Page::countPages(a.get_allocator().paHandle_.pPool_->findChain(nNodeSize)->pPage_);
+  }
+  RG_EXPECT(anPages[0] > 2 && anPages[1] == 1);
+  ChainSizeHistory::clear(nNodeSize);
+
+  // Bitmap Pages: a list rebuilt after churn gets its nodes in address order, unsorted:
+  std::list<int, PrivateAllocator<int, NewDeleteBackend, BitmapTraits>> b;
+  const size_t nIntNodeSize = sizeof(int) + 2 * sizeof(void*);
+  b.get_allocator().reserve(4000, nIntNodeSize);
+  for (int j = 0; j < 4000; ++j)
+    b.push_back(j);
+  b.sort([](int x, int y) { return (x * 7919) % 4001 < (y * 7919) % 4001; });
+  b.clear(); // Freed in the shuffled order
+  for (int j = 0; j < 4000; ++j)
+    b.push_back(j);
+  const int* prev = nullptr;
+  bool bInOrder = true;
+  for (auto& item : b)
+    bInOrder = bInOrder && (!prev || std::less<const int*>()(prev, &item)), prev = &item;
+  BitmapPageChain* bitmaps = b.get_allocator().paHandle_.pPool_->findChain(nIntNodeSize);
+  RG_EXPECT(bInOrder && bitmaps && BitmapPage::countPages(bitmaps->pPage_) == 1);
+  RG_EXPECT(bitmaps->nLiveBlocks_ == 4000 && b.get_allocator().stats().nLiveBlocks == 
+                                               (RG_PRIVATEALLOCATOR_STATS ? 4000 : 0));
+}
+
+RG_ADD_UNITTEST2(test_AllocatorTraits, 2)
+
+//========================================================================================
+// sortFreeBlocks(): a list rebuilt after churn gets its nodes in address order again.
+//________________________________________________________________________________________
+void test_SortFreeBlocks()
+{
+  std::list<int, PrivateAllocator<int>> l;
+  for (int j = 0; j < 10000; ++j)
+    l.push_back(j);
+  l.sort([](int a, int b) { return (a * 7919) % 10007 < (b * 7919) % 10007; });
+  auto isInAddressOrder = [&l]()
+  {
+    const int* prev = nullptr;
+    for (auto& item : l)
+      if (prev && !std::less<const int*>()(prev, &item))
+        return false;
+      else
+        prev = &item;
+    return true;
+  };
+  RG_EXPECT(!isInAddressOrder());
+
+  l.clear();
+  for (int j = 0; j < 10000; ++j)
+    l.push_back(j);
+  RG_EXPECT(!isInAddressOrder()); // Churned: freed in the shuffled order
+
+  l.sort([](int a, int b) { return (a * 7919) % 10007 < (b * 7919) % 10007; });
+  l.clear();
+  l.get_allocator().sortFreeBlocks();
+  for (int j = 0; j < 10000; ++j)
+    l.push_back(j);
+  RG_EXPECT(isInAddressOrder());
+}
+
+RG_ADD_UNITTEST2(test_SortFreeBlocks, 1)
+
+//========================================================================================
+// compact(): the elements, in the same order, in fewer Pages of a new clique; in
+// traversal order within each Page (e.g. the single reserved one).
+//________________________________________________________________________________________
+template <typename Container>
+static bool areItemsInAddressOrder(const Container& c)
+{
+  const void* prev = nullptr;
+  for (auto& item : c)
+    if (prev && !std::less<const void*>()(prev, &item))
+      return false;
+    else
+      prev = &item;
+  return true;
+}
+
+void test_Compact()
+{
+  typedef PrivateAllocator<int> PA;
+  std::list<int, PA> l;
+  std::multiset<int, std::greater<int>, PA> s;
+  std::unordered_set<int, std::hash<int>, std::equal_to<int>, PA> h;
+  for (int j = 0; j < 10000; ++j)
+    l.push_back(j), s.insert(j), h.insert(j);
+  l.remove_if([](int n) { return n % 10 != 0; }); // Thin out all the Pages
+  for (auto i = s.begin(); i != s.end(); /**/)
+    i = *i % 10 ? s.erase(i) : std::next(i);
+  for (int j = 0; j < 10000; ++j)
+    if (j % 10)
+      h.erase(j);
+  std::vector<int> items(l.begin(), l.end());
+  auto stats = l.get_allocator().stats(), setStats = s.get_allocator().stats();
+  PA before = l.get_allocator();
+
+  compact(l);
+  RG_EXPECT(l.get_allocator() != before && std::equal(l.begin(), l.end(), items.begin()));
+  RG_EXPECT(l.size() == 1000 && areItemsInAddressOrder(l));
+  RG_EXPECT(before.stats().nLiveBlocks == 0 && l.get_allocator().stats().nLiveBlocks == 1000);
+  RG_EXPECT(l.get_allocator().stats().nPageBytes < stats.nPageBytes / 4 || 
+            !RG_PRIVATEALLOCATOR_STATS);
+
+  compact(s); // Not shared: the old clique is winked out
+  RG_EXPECT(s.size() == 1000 && *s.begin() == 9990 && *s.rbegin() == 0);
+  RG_EXPECT(s.get_allocator().stats().nPageBytes < setStats.nPageBytes / 4 || 
+            !RG_PRIVATEALLOCATOR_STATS);
+  compact(h);
+  RG_EXPECT(h.size() == 1000 && h.count(0) && h.count(9990) && !h.count(1));
+  l.push_back(1), s.insert(1), h.insert(1); // Still usable
+  RG_EXPECT(l.back() == 1 && s.count(1) && h.count(1));
+
+  // Elements with destructors: the old nodes are freed one by one, but the old clique 
+  // is not trimmed on the way (its Pages all go right after):
+  typedef PrivateAllocator<std::string> PAS;
+  std::list<std::string, PAS> strings(1000, "a string");
+  strings.remove_if([](const std::string&) { static int n; return n++ % 10 != 0; });
+  PAS old = strings.get_allocator();
+  old.setTrimThreshold(1);
+  size_t nPages = old.stats().nPages;
+  compact(strings);
+  RG_EXPECT(strings.size() == 100 && strings.front() == "a string");
+  RG_EXPECT(old.stats().nLiveBlocks == 0 && old.stats().nPages == nPages);
+}
+
+RG_ADD_UNITTEST2(test_Compact, 1)
+
+//========================================================================================
+// winkOut(): the Pages go at once, unless the clique is shared or has arrays; the 
+// container is left empty and usable either way.
+//________________________________________________________________________________________
+void test_WinkOut()
+{
+  typedef PrivateAllocator<int> PA;
+  std::list<int, PA> l(1000, 1);
+  std::map<int, int, std::less<int>, PrivateAllocator<std::pair<const int, int>>> m;
+  std::unordered_set<int, std::hash<int>, std::equal_to<int>, PA> h;
+  for (int j = 0; j < 1000; ++j)
+    m[j] = j, h.insert(j);
+  RG_EXPECT(l.get_allocator().getCliqueSize() > 1);
+  size_t nPages = getThreadStats().nPages,
+         nCacheCapacity = PageCache::getCapacity();
+  PageCache::setCapacity(0); // So that the Pages go to the backend
+
+  RG_EXPECT(winkOut(l) && winkOut(m));
+  PageCache::setCapacity(nCacheCapacity);
+  RG_EXPECT(l.empty() && m.empty());
+  // (Counts of Pages freed across threads may wrap around, but their difference not):
+  RG_EXPECT(nPages - getThreadStats().nPages >= 2 || !RG_PRIVATEALLOCATOR_STATS);
+  l.push_back(2), m[2] = 2; 
+  RG_EXPECT(l.back() == 2 && m.size() == 1 && l.get_allocator().getCliqueSize() == 2);
+
+  // Shared: by a copy of the allocator, or another container; the nodes are returned:
+  PA shared = l.get_allocator();
+  std::list<int, PA> other(shared);
+  other.push_back(3);
+  RG_EXPECT(!winkOut(l));
+  RG_EXPECT(l.empty() && other.back() == 3);
+  RG_EXPECT(shared.stats().nLiveBlocks == 1 || !RG_PRIVATEALLOCATOR_STATS);
+  RG_EXPECT(!shared.winkOut(0));
+
+  // The bucket array of an unordered container is not in the Pages:
+  RG_EXPECT(!winkOut(h));
+  RG_EXPECT(h.empty() && h.insert(4).second);
+
+  // The elements are still destroyed (e.g. their own heap blocks are freed):
+  std::list<std::string, PrivateAllocator<std::string>> strings(100, std::string(100, 's'));
+  RG_EXPECT(winkOut(strings) && strings.empty());
+}
+
+RG_ADD_UNITTEST2(test_WinkOut, 1)
+
+//========================================================================================
+// Over-aligned types: Page blocks (list nodes), arrays and blocks too large for Pages.
+//________________________________________________________________________________________
+struct alignas(64) CacheLine { int n; };
+struct alignas(256) LargeAligned { int n; };
+
+template <typename Container>
+static bool areAllItemsAligned(const Container& c)
+{
+  const size_t nAlign = alignof(typename Container::value_type);
+  for (auto& item : c)
+    if (size_t(&item) & (nAlign - 1))
+      return false;
+  return true;
+}
+
+void test_OverAlignedTypes()
+{
+  std::list<CacheLine, PrivateAllocator<CacheLine>> l(1000);
+  std::vector<CacheLine, PrivateAllocator<CacheLine>> v(1000);
+  std::list<LargeAligned, PrivateAllocator<LargeAligned>> ll(100);
+  RG_EXPECT(areAllItemsAligned(l) && areAllItemsAligned(v) && areAllItemsAligned(ll));
+  RG_EXPECT(l.get_allocator().stats().nLiveBlocks == 1000);
+
+  std::map<int, CacheLine, std::less<int>,
+           PrivateAllocator<std::pair<const int, CacheLine>>> m;
+  bool bAligned = true;
+  for (int j = 0; j < 1000; ++j)
+    bAligned = bAligned && size_t(&m[j]) % 64 == 0;
+  RG_EXPECT(bAligned && m.size() == 1000);
+}
+
+RG_ADD_UNITTEST2(test_OverAlignedTypes, 2)
+
 } // namespace
 
 
@@ -112,6 +520,13 @@ template class std::unordered_multiset<int,
                                        std::equal_to<int>, 
                                        PrivateAllocator<int>>;
 
+// With a non-default backend:
+typedef std::vector<int, PrivateAllocator<int, MallocBackend>> PA_malloc_vector;
+template class std::vector<int, PrivateAllocator<int, MallocBackend>>;
+
+typedef std::list<int, PrivateAllocator<int, MallocBackend>> PA_malloc_list;
+template class std::list<int, PrivateAllocator<int, MallocBackend>>;
+
 template <typename C>
 void testPA_Container()
 {
@@ -145,6 +560,8 @@ void testPA_Container()
     C a {1}, b;
     b = std::move(a); 
     RG_EXPECT(!b.empty() && a.empty());
+    a = C{2}; // The moved-from container is reusable
+    RG_EXPECT(!a.empty() && a != b);
   }
   // Swap
   {
@@ -173,5 +590,22 @@ RG_TEST(PA_set)
 RG_TEST(PA_multiset)
 RG_TEST(PA_unordered_set)
 RG_TEST(PA_unordered_multiset)
+RG_TEST(PA_malloc_vector)
+RG_TEST(PA_malloc_list)
+
+//========================================================================================
+// Arrays too large to cache, served directly by the backend
+//________________________________________________________________________________________
+static void testPA_LargeArrays()
+{
+  PA_malloc_vector v(cnMaxCachedArrayByteSize_ / sizeof(int) + 1, 17);
+  PA_malloc_vector cpy(v);
+  RG_EXPECT(cpy == v && v.back() == 17);
+  v.clear();
+  v.shrink_to_fit();
+  RG_EXPECT(v.capacity() == 0);
+}
+
+RG_ADD_UNITTEST("PrivateAllocator: large arrays", testPA_LargeArrays, 1)
 
 // ------------------------ End Of File --------------------------------------
@@ -20,6 +20,8 @@
 #include "BackendAllocators.h"
 
 #include <memory> 
+#include <new>
+#include <type_traits>
 #include <cassert>
 
 // ------------------------------------- Definitions -------------------------------------
@@ -27,10 +29,42 @@
 namespace rg_privateallocator
 { 
 
+//****************************************************************************************
+// Tuning of a PrivateAllocator<> instantiation; derive and override any of these, e.g.
+//   struct SmallPages : DefaultAllocatorTraits { static const size_t cnMaxPageShift = 12; };
+//   std::list<int, PrivateAllocator<int, NewDeleteBackend, SmallPages>> myList;
+// The Page shifts are log2 of byte sizes; see PageGrowth.
+//________________________________________________________________________________________
+struct DefaultAllocatorTraits
+{
+  // Larger blocks are allocated as arrays; at most cnMaxBlockSize_:
+  static const size_t cnMaxBlockSize = cnMaxBlockSize_; 
+  // 0: the smallest Page fitting a few blocks:
+  static const size_t cnFirstPageShift = 0; 
+  // Each next Page is 2^cnGrowthShift times larger than the previous one:
+  static const size_t cnGrowthShift = 1;    
+  // 0: the largest that the Backend allows (cnMaxPageShift_ unless huge-page capable):
+  static const size_t cnMaxPageShift = 0;   
+  // Pad the blocks to never straddle two cache lines (e.g. 24-byte nodes to 32):
+  static const bool cbCacheLineBlocks = false;
+  // Stagger the blocks of the Pages by up to cnPageColors - 1 cache lines:
+  static const size_t cnPageColors = 1;
+  // Size the first Page for the typical final size of the earlier cliques (of all 
+  // types adapting so) with the same block size - at least cnFirstPageShift:
+  static const bool cbAdaptiveFirstPage = false;
+  // Track the free blocks of each Page in a bitmap (see BitmapPage) instead of a free 
+  // list: the blocks go out in address order, with no sorting; not colored:
+  static const bool cbBitmapPages = false;
+};
+
 //****************************************************************************************
 // Private (per container instance) C++ STL Allocator
+// 'Backend' (see BackendAllocators.h) provides the Pages and the arrays; it is called
+// directly for the arrays too large to cache. 'Traits' tune the Page sizes.
 //________________________________________________________________________________________
-template <typename T> 
+template <typename T, 
+          typename Backend = NewDeleteBackend, 
+          typename Traits = DefaultAllocatorTraits> 
 class PrivateAllocator 
 {
 public:
@@ -38,26 +72,73 @@ public:
   using value_type = T;
 
 // Ctors, dtor:
+  // Creates the pool of a new clique (so that copies only need to share it):
   PrivateAllocator();
+  // Joins 'from's clique; never allocates:
   PrivateAllocator(const PrivateAllocator& from) noexcept; 
-  // Copy ctor is OK when 'move' is required
+  // Joins 'from's clique too, as the copy ctor does: 'from' stays equal to this (so 
+  // that a moved-from container can still free what it may hold, and be reused):
+  PrivateAllocator(PrivateAllocator&& from) noexcept; 
 
   template <typename Other> 
-  explicit PrivateAllocator(const PrivateAllocator<Other>& other) noexcept; 
+  explicit PrivateAllocator(const PrivateAllocator<Other, Backend, Traits>& other) noexcept; 
 
   ~PrivateAllocator();
 
 // Assignments:
-  // Move: used in container 'swap()'. Invokes *copy* ctor.
+  // Move: used in container move assignment. Joins rhs's clique (as the move ctor 
+  // does), in constant time; touches no Pages.
   void operator = (PrivateAllocator&& rhs) noexcept; 
 
-  // Copy: used in container assigments. Invokes *default* ctor.
+  // Copy: joins rhs's clique, as the copy ctor does. Not used by containers (see 
+  // propagate_on_container_copy_assignment).
   void operator = (const PrivateAllocator& rhs) noexcept; 
 
 // Allocation/deallocation:
  	T* allocate(size_t n);
  	void deallocate(T* p, size_t n) noexcept;
 
+// Release of unused memory (shared by the whole clique):
+  // Return the fully-free Pages (and the cached arrays) to the backend now:
+  void trim();
+  // Return the fully-free Pages automatically, each time that the free blocks of 
+  // a single size grow by 'nFreeBytes'; 0 (the default) disables it:
+  void setTrimThreshold(size_t nFreeBytes);
+
+// Locality of the free blocks (shared by the whole clique), which churn scatters:
+  // Relink the free blocks in address order, so that the next ones go out sequentially:
+  void sortFreeBlocks();
+  // Do it automatically, each 'nReturns' blocks returned to a single size (best about 
+  // the container size); 0 (the default) disables it:
+  void setSortThreshold(size_t nReturns);
+
+// Statistics of the whole clique (see AllocatorStats); cheap, walks no blocks:
+  AllocatorStats stats() const;
+
+// Wink-out: release of the whole clique at once, with its blocks still live (see the
+// winkOut() function):
+  // The number of allocators in the clique:
+  size_t getCliqueSize() const;
+  // Leave the clique, with its deallocations doing nothing from now on: its Pages go
+  // with its last allocator, blocks and all - provided that the rest of the clique are 
+  // 'nOthers' allocators about to be destroyed (e.g. by the container holding them), 
+  // on the owner thread, and that all its allocations were blocks (arrays are not in 
+  // the Pages). This is then left as if default-constructed. Otherwise does nothing 
+  // and returns false:
+  bool winkOut(size_t nOthers) noexcept;
+
+// Pre-creation of Pages for 'nBlocks' more blocks (of 'nBlockSize' bytes, e.g. the node 
+// size of a node-based container), in as few Pages (backend calls) as Traits allow. 
+// No default size: the allocator of a node-based container is for its value_type, 
+// not for its nodes:
+  void reserve(size_t nBlocks, size_t nBlockSize);
+  // Same, for each block size of 'model's clique: as many blocks as it has live, up to 
+  // nMaxBlocks (e.g. the size of the container moving from that clique to this one):
+  void reserveLike(const PrivateAllocator& model, size_t nMaxBlocks);
+
+// Exchange of the clique memberships (used in container 'swap()'); constant time:
+  void swap(PrivateAllocator& other) noexcept;
+
 // Implement 'Allocator concept' flags; see:
 // https://en.cppreference.com/w/cpp/named_req/AllocatorAwareContainer
   // All allocators are *not* equal:
@@ -66,163 +147,411 @@ public:
   PrivateAllocator select_on_container_copy_construction() const;
   // Containers *will* replace the destination allocator on move assignment:
   using propagate_on_container_move_assignment = std::true_type;
-  // Containers *will* replace the destination allocator on copy assignment:
-  using propagate_on_container_copy_assignment = std::true_type;
+  // Containers keep their own allocator (and clique) on copy assignment:
+  using propagate_on_container_copy_assignment = std::false_type;
   // Swap the allocators in container 'swap':
 	using propagate_on_container_swap = std::true_type;
 
 // Implementation
 private:
+  using Pool = typename std::conditional<Traits::cbBitmapPages, 
+                                         BitmapPagePool, PagePool>::type;
   static const size_t cnBlockSize_ = sizeof(T);
+  // Single blocks get alignof(T) from the Page layout; arrays of over-aligned T come 
+  // straight from Backend, aligned:
+  static const bool cbOverAligned_ = alignof(T) > cnMaxAlign;
+  static_assert(Traits::cnMaxBlockSize <= cnMaxBlockSize_, "Traits: cnMaxBlockSize");
+  static_assert(Traits::cnGrowthShift > 0, "Traits: cnGrowthShift");
+  static_assert(Traits::cnMaxPageShift <= cnMaxHugePageShift_, "Traits: cnMaxPageShift");
+  static_assert(Traits::cnPageColors > 0 && Traits::cnPageColors <= cnMaxPageColors_ &&
+                (Traits::cnPageColors & (Traits::cnPageColors - 1)) == 0, 
+                "Traits: cnPageColors");
   // Whether to use the Page allocation for allocate()/deallocate() of 'n' items
   bool shouldUsePageAllocation(size_t n); 
+  static PageGrowth getGrowth(); // As of Traits
+  Pool* getOrCreatePool(); // Using Backend
+  void addFallback(); // Of an array passed directly to Backend
 
 public: // Used in global operator==()
-  PageHandle paHandle_; 
+  BasicPageHandle<Pool> paHandle_; 
 };
 
 //========================================================================================
 // Equality operators as per https://en.cppreference.com/w/cpp/named_req/Allocator
 //________________________________________________________________________________________
-template <class T, class U>
-bool operator == (PrivateAllocator<T> const& lhs, PrivateAllocator<U> const& rhs) noexcept
+template <class T, class U, class Backend, class Traits>
+bool operator == (PrivateAllocator<T, Backend, Traits> const& lhs, 
+                  PrivateAllocator<U, Backend, Traits> const& rhs) noexcept
+{
+  return lhs.paHandle_.inSameClique(&rhs.paHandle_);
+}
+
+template <class T, class Backend, class Traits>
+void swap(PrivateAllocator<T, Backend, Traits>& lhs, 
+          PrivateAllocator<T, Backend, Traits>& rhs) noexcept
 {
-  auto p1 = lhs.paHandle_.pPage_,
-       p2 = rhs.paHandle_.pPage_;
-  if (p1 || p2)
-    return p1 == p2;
-  bool bRet = lhs.paHandle_.inSameList(&rhs.paHandle_);
-  return bRet;
+  lhs.swap(rhs);
 }
 
-template <class T, class U>
-bool operator != (PrivateAllocator<T> const& lhs, PrivateAllocator<U> const& rhs) noexcept
+template <class T, class U, class Backend, class Traits>
+bool operator != (PrivateAllocator<T, Backend, Traits> const& lhs, 
+                  PrivateAllocator<U, Backend, Traits> const& rhs) noexcept
 {
     return !(lhs == rhs);
 }
 
 //========================================================================================
 //________________________________________________________________________________________
-template <typename T>
-PrivateAllocator<T>::PrivateAllocator()
+template <typename T, typename Backend, typename Traits>
+PrivateAllocator<T, Backend, Traits>::PrivateAllocator()
 {
+  getOrCreatePool();
 }
   
 //========================================================================================
-// Insert itself into 'from's clique-list
+// Join 'from's clique: one more reference to its pool (which the default ctor created).
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+PrivateAllocator<T, Backend, Traits>::PrivateAllocator(const PrivateAllocator& from) noexcept
+{
+  if (Pool* pool = from.paHandle_.pPool_)
+    paHandle_.share(pool);
+}
+
+//========================================================================================
 //________________________________________________________________________________________
-template <typename T>
-PrivateAllocator<T>::PrivateAllocator(const PrivateAllocator& from) noexcept
+template <typename T, typename Backend, typename Traits>
+PrivateAllocator<T, Backend, Traits>::PrivateAllocator(PrivateAllocator&& from) noexcept
 {
-  PageHandle* fromPaHandle = const_cast<PageHandle*>(&from.paHandle_);
-  paHandle_.addSelfToList(fromPaHandle);
+  if (Pool* pool = from.paHandle_.pPool_)
+    paHandle_.share(pool);
 }
 
 //========================================================================================
-// Insert itself into 'from's clique-list
+// Join 'from's clique, as the copy ctor does.
 //________________________________________________________________________________________
-template <typename T>
+template <typename T, typename Backend, typename Traits>
 template <typename Other>
-PrivateAllocator<T>::PrivateAllocator(const PrivateAllocator<Other>& from) noexcept
+PrivateAllocator<T, Backend, Traits>::PrivateAllocator(
+  const PrivateAllocator<Other, Backend, Traits>& from) noexcept
 {
-  // Same as copy ctor
-  PageHandle* fromPaHandle = const_cast<PageHandle*>(&from.paHandle_);
-  paHandle_.addSelfToList(fromPaHandle);
+  if (Pool* pool = from.paHandle_.pPool_)
+    paHandle_.share(pool);
 }
 
 //========================================================================================
+// The last allocator of the clique destroys the pool (see PageHandle).
 //________________________________________________________________________________________
-template <typename T>
-PrivateAllocator<T>::~PrivateAllocator()
+template <typename T, typename Backend, typename Traits>
+PrivateAllocator<T, Backend, Traits>::~PrivateAllocator()
 {
-  if (paHandle_.isSingleInList())
-  { 
-    if (paHandle_.pPage_)
-      Page::deleteAllPages(paHandle_.pPage_);
-  }
-  else
-    paHandle_.removeSelfFromList();
 }
 
 //========================================================================================
-// Move assighment is used in container *swap*.
+// Move assighment is used in container *move assignment*. Shares rhs's clique, as the 
+// copy assignment does: this one's is released, and rhs stays in it.
 //________________________________________________________________________________________
-template <typename T>
-void PrivateAllocator<T>::operator = (PrivateAllocator&& rhs) noexcept
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::operator = (PrivateAllocator&& rhs) noexcept
 {
-  this->~PrivateAllocator();
-  new (this) PrivateAllocator(rhs); // Invoke copy ctor, participate in clique ownership.
+  *this = static_cast<const PrivateAllocator&>(rhs);
 }
 
 //========================================================================================
-// Copy assignment is used in container *assignments*.
 //________________________________________________________________________________________
-template <typename T>
-void PrivateAllocator<T>::operator = (const PrivateAllocator& rhs) noexcept
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::swap(PrivateAllocator& other) noexcept
 {
-  if (this != &rhs)
-  { 
-    this->~PrivateAllocator();
-    new (this) PrivateAllocator(); // Default ctor
-  }
+  paHandle_.swap(other.paHandle_);
+}
+
+//========================================================================================
+// rhs's pool gets the new reference before this one's is released, in case they are 
+// the same.
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::operator = (const PrivateAllocator& rhs) noexcept
+{
+  BasicPageHandle<Pool> joined;
+  if (Pool* pool = rhs.paHandle_.pPool_)
+    joined.share(pool);
+  paHandle_.swap(joined);
 }
 
 //========================================================================================
 // The only requests serverd by the Page allocator are for:
 //   - signle blocks 
 //   - that are small enough 
+// Each block size is served by its own PageChain, so rebound types don't interfere.
 //________________________________________________________________________________________
-template <typename T>
-inline bool PrivateAllocator<T>::shouldUsePageAllocation(size_t n) 
+template <typename T, typename Backend, typename Traits>
+inline bool PrivateAllocator<T, Backend, Traits>::shouldUsePageAllocation(size_t n) 
 {
-  if (n != 1 || cnBlockSize_ > cnMaxBlockSize_)
-    return false;
+  return n == 1 && cnBlockSize_ <= Traits::cnMaxBlockSize;
+}
 
-  Page* pa = paHandle_.pPage_;
-  bool ret = !pa || cnBlockSize_ <= pa->getBlockSize();;
-  return ret;
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+inline PageGrowth PrivateAllocator<T, Backend, Traits>::getGrowth()
+{
+  PageGrowth growth;
+  growth.nFirstPageShift = Traits::cnFirstPageShift;
+  growth.nGrowthShift = Traits::cnGrowthShift;
+  growth.nMaxPageShift = Traits::cnMaxPageShift;
+  growth.bCacheLineBlocks = Traits::cbCacheLineBlocks;
+  growth.nPageColors = Traits::cnPageColors;
+  growth.bAdaptiveFirstPage = Traits::cbAdaptiveFirstPage;
+  return growth;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+inline typename PrivateAllocator<T, Backend, Traits>::Pool* 
+PrivateAllocator<T, Backend, Traits>::getOrCreatePool()
+{
+  return paHandle_.getOrCreatePool(&BackendAdapter<Backend>::instance, getGrowth());
 }
 
 //========================================================================================
+// Creates the pool just for counting, if that's enabled.
 //________________________________________________________________________________________
-template <typename T>
-T* PrivateAllocator<T>::allocate(size_t n)
+template <typename T, typename Backend, typename Traits>
+inline void PrivateAllocator<T, Backend, Traits>::addFallback()
+{
+  // Even without statistics: winkOut() can't release such arrays.
+  getOrCreatePool()->addFallback();
+}
+
+//========================================================================================
+// Arrays too large to cache, or of over-aligned T, go straight to Backend.
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+T* PrivateAllocator<T, Backend, Traits>::allocate(size_t n)
 {
   void* ret;
   if (shouldUsePageAllocation(n))
   { 
-    Page* page = paHandle_.getOrCreatePage(cnBlockSize_, true /*needFreeBlock*/);
-    assert(page);
-    ret = page->takeBlock();
+    Pool* pool = getOrCreatePool();
+    ret = pool->takeBlock(cnBlockSize_);
+  }
+  else if (cbOverAligned_)
+  {
+    addFallback();
+    ret = Backend::allocateAlignedRaw(n * cnBlockSize_, alignof(T));
+  }
+  else if (n * cnBlockSize_ > cnMaxCachedArrayByteSize_)
+  {
+    addFallback();
+    ret = Backend::allocateRaw(n * cnBlockSize_);
   }
   else
-    ret = theBackendAllocator->allocateRaw(n * cnBlockSize_);
+    ret = getOrCreatePool()->allocateArray(n * cnBlockSize_);
   return static_cast<T*>(ret);
 }
 
 //========================================================================================
 //________________________________________________________________________________________
-template <typename T>
-void PrivateAllocator<T>::deallocate(T* p, size_t n) noexcept
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::deallocate(T* p, size_t n) noexcept
 {
   if (shouldUsePageAllocation(n))
   { 
-    Page* page = paHandle_.getOrCreatePage(cnBlockSize_, false /*needFreeBlock*/);
-    assert (page); // Should have been there during allocate()
-    page->returnBlock(p);
+    Pool* pool = paHandle_.pPool_;
+    assert (pool); // Should have been there during allocate()
+    pool->returnBlock(p, cnBlockSize_);
   }
+  else if (cbOverAligned_)
+    Backend::deallocateAlignedRaw(p, n * cnBlockSize_);
+  else if (n * cnBlockSize_ > cnMaxCachedArrayByteSize_)
+    Backend::deallocateRaw(p);
   else
-    theBackendAllocator->deallocateRaw(p);
+  {
+    Pool* pool = paHandle_.pPool_;
+    assert (pool); // Created with the allocator
+    pool->deallocateArray(p, n * cnBlockSize_);
+  }
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::trim()
+{
+  if (Pool* pool = paHandle_.pPool_)
+    pool->trim();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::setTrimThreshold(size_t nFreeBytes)
+{
+  getOrCreatePool()->setTrimThreshold(nFreeBytes);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::sortFreeBlocks()
+{
+  if (Pool* pool = paHandle_.pPool_)
+    pool->sortFreeBlocks();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::setSortThreshold(size_t nReturns)
+{
+  getOrCreatePool()->setSortThreshold(nReturns);
+}
+
+//========================================================================================
+// Larger blocks are arrays, which are not reserved.
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::reserve(size_t nBlocks, size_t nBlockSize)
+{
+  if (nBlockSize > 0 && nBlockSize <= Traits::cnMaxBlockSize)
+    getOrCreatePool()->reserve(nBlocks, nBlockSize);
 }
 
 //========================================================================================
 //________________________________________________________________________________________
-template <typename T>
-PrivateAllocator<T> PrivateAllocator<T>::select_on_container_copy_construction() const
+template <typename T, typename Backend, typename Traits>
+void PrivateAllocator<T, Backend, Traits>::reserveLike(const PrivateAllocator& model, 
+                                                       size_t nMaxBlocks)
+{
+  if (Pool* pool = model.paHandle_.pPool_)
+    getOrCreatePool()->reserveLike(pool, nMaxBlocks);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+AllocatorStats PrivateAllocator<T, Backend, Traits>::stats() const
+{
+  if (Pool* pool = paHandle_.pPool_)
+    return pool->getStats();
+  return AllocatorStats();
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+size_t PrivateAllocator<T, Backend, Traits>::getCliqueSize() const
+{
+  if (Pool* pool = paHandle_.pPool_)
+    return pool->getRefCount();
+  return 1;
+}
+
+//========================================================================================
+// The pool is flagged, not destroyed: the other allocators still point to it, and the 
+// last of them releases it as usual.
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+bool PrivateAllocator<T, Backend, Traits>::winkOut(size_t nOthers) noexcept
+{
+  Pool* pool = paHandle_.pPool_;
+  if (!pool || !pool->releaseAllAtOnce(nOthers + 1))
+    return false;
+  paHandle_.release(); // The pool is delay-created again, if needed
+  return true;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+template <typename T, typename Backend, typename Traits>
+PrivateAllocator<T, Backend, Traits> 
+  PrivateAllocator<T, Backend, Traits>::select_on_container_copy_construction() const
 {
   return PrivateAllocator();
 }
 
+//========================================================================================
+// Empties 'container' and gives it a clique of its own: an empty copy of it gets a new
+// allocator (see select_on_container_copy_construction()), which move assignment then
+// hands over (propagate_on_container_move_assignment).
+//________________________________________________________________________________________
+template <typename Container>
+void renewClique(Container& container)
+{
+  container.clear();
+  container = Container(container);
+}
+
+//========================================================================================
+// Destroys the elements of a node-based container (std::list, sets and maps) using 
+// PrivateAllocator<> without returning each node to its Page: all the Pages of its 
+// clique are released at once instead. The container's destructor still walks the 
+// nodes, to destroy the elements, but that is all it does with them. The container is
+// left empty, with a clique of its own (as after compact()), either way.
+// Returns false if the clique can't be winked out (see PrivateAllocator::winkOut()):
+// when it is shared with other containers, or has served arrays - e.g. the bucket 
+// arrays of unordered containers, or the maps of std::deque; then the nodes are 
+// returned as usual.
+//________________________________________________________________________________________
+template <typename Container>
+bool winkOut(Container& container)
+{
+  // The clique members held by an instance of Container: those that the move adds 
+  // (moves share the clique)
+  auto allocator = container.get_allocator();
+  size_t nHeld = allocator.getCliqueSize();
+  Container detached(std::move(container));
+  nHeld = allocator.getCliqueSize() - nHeld;
+
+  // Then the clique is 'detached's and 'allocator's only (unless shared further):
+  renewClique(container);
+  return allocator.winkOut(nHeld);
+} // 'detached' goes here, with the clique if winked out
+
+//========================================================================================
+// Releases the clique of 'allocator', about to go with 'nHeld' other allocators (e.g.
+// those of a container): at once, if winkOut() can do it; otherwise block by block, 
+// but without trimming or sorting the free blocks on the way, as all the Pages are 
+// released right after.
+//________________________________________________________________________________________
+template <typename Allocator>
+void releaseInBulk(Allocator& allocator, size_t nHeld)
+{
+  if (allocator.winkOut(nHeld))
+    return;
+  allocator.setTrimThreshold(0);
+  allocator.setSortThreshold(0);
+}
+
+//========================================================================================
+// Like shrink_to_fit(), for node-based containers (std::list, sets, maps and the 
+// unordered ones) using PrivateAllocator<>: after long churn, the live nodes may be 
+// spread thinly over many Pages. This moves the elements, in traversal order, into 
+// new nodes of a new clique - with Pages reserved at once for as many blocks of each 
+// size as the old clique has live - so that they are contiguous; then the old clique,
+// with all its Pages, is released at once (see releaseInBulk()).
+// The container keeps its comparator/hash; the new clique starts with default settings
+// (e.g. no trim threshold). Invalidates all iterators and references.
+//________________________________________________________________________________________
+template <typename Container>
+void compact(Container& container)
+{
+  // The clique members held by an instance of Container (see winkOut()):
+  auto allocator = container.get_allocator();
+  size_t nHeld = allocator.getCliqueSize();
+  Container old(std::move(container));
+  nHeld = allocator.getCliqueSize() - nHeld;
+
+  renewClique(container);
+  // get_allocator() returns a copy, which shares the container's (new) clique: the 
+  // Pages reserved through it are the container's.
+  container.get_allocator().reserveLike(allocator, old.size());
+  for (auto& item : old)
+    container.insert(container.end(), std::move(item));
+  releaseInBulk(allocator, nHeld);
+} // 'old' goes here, with the old clique if winked out
+
 // -------------------------------- End Of File ------------------------------------------
 
 } // namespace rg_privateallocator
@@ -0,0 +1,190 @@
+// PrivatePoolResource.cpp
+//
+// Implementation file, along with the unittests; empty before C++17.
+//
+// Author:
+//    Radoslav Getov, getov@mail.com
+
+
+// ------------------------ #Includes ---------------------------------------
+
+#include "PrivatePoolResource.h"
+
+#if RG_PRIVATEPOOLRESOURCE
+
+#include "Unittest.h"
+
+#include <list>
+#include <map>
+#include <string>
+#include <cassert>
+#include <algorithm>
+
+// --------------------------- Definitions -------------------------------------
+
+namespace rg_privateallocator
+{
+
+//========================================================================================
+//________________________________________________________________________________________
+PrivatePoolResource::PrivatePoolResource(const BackendAllocator* backend,
+                                         const PageGrowth&       growth)
+  : pBackend_(backend),
+    growth_(growth)
+{
+}
+
+//========================================================================================
+// Blocks of a size divisible by the alignment are aligned (see 
+// Page::calcFirstBlockOffset()). The rounded size stays within cnMaxBlockSize_, a 
+// multiple of the alignment.
+//________________________________________________________________________________________
+size_t PrivatePoolResource::calcBlockSize(size_t nBytes, size_t nAlignment)
+{
+  assert (nAlignment > 0 && (nAlignment & (nAlignment - 1)) == 0);
+  if (nBytes > cnMaxBlockSize_ || nAlignment > cnMaxBlockSize_)
+    return 0;
+  return roundUp(nBytes ? nBytes : 1, std::max(nAlignment, cnMinAlign));
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+PagePool* PrivatePoolResource::getOrCreatePool()
+{
+  return paHandle_.getOrCreatePool(pBackend_, growth_);
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void* PrivatePoolResource::do_allocate(size_t nBytes, size_t nAlignment)
+{
+  if (size_t nBlockSize = calcBlockSize(nBytes, nAlignment))
+    return getOrCreatePool()->takeBlock(nBlockSize);
+  if (nAlignment > cnMaxAlign)
+  {
+    getOrCreatePool()->addFallback();
+    return pBackend_->allocateAlignedRaw(nBytes, nAlignment);
+  }
+  return getOrCreatePool()->allocateArray(nBytes);
+}
+
+//========================================================================================
+// The pool is there since do_allocate().
+//________________________________________________________________________________________
+void PrivatePoolResource::do_deallocate(void* p, size_t nBytes, size_t nAlignment)
+{
+  PagePool* pool = paHandle_.pPool_;
+  assert (pool);
+  if (size_t nBlockSize = calcBlockSize(nBytes, nAlignment))
+    pool->returnBlock(p, nBlockSize);
+  else if (nAlignment > cnMaxAlign)
+    pBackend_->deallocateAlignedRaw(p, nBytes);
+  else
+    pool->deallocateArray(p, nBytes);
+}
+
+//========================================================================================
+// Memory of one resource can't be freed by another.
+//________________________________________________________________________________________
+bool PrivatePoolResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+  return this == &other;
+}
+
+//========================================================================================
+//________________________________________________________________________________________
+void PrivatePoolResource::trim()
+{
+  if (PagePool* pool = paHandle_.pPool_)
+    pool->trim();
+}
+
+void PrivatePoolResource::setTrimThreshold(size_t nFreeBytes)
+{
+  getOrCreatePool()->setTrimThreshold(nFreeBytes);
+}
+
+void PrivatePoolResource::sortFreeBlocks()
+{
+  if (PagePool* pool = paHandle_.pPool_)
+    pool->sortFreeBlocks();
+}
+
+void PrivatePoolResource::setSortThreshold(size_t nReturns)
+{
+  getOrCreatePool()->setSortThreshold(nReturns);
+}
+
+void PrivatePoolResource::reserve(size_t nBlocks, size_t nBlockSize)
+{
+  if (nBlockSize > 0 && nBlockSize <= cnMaxBlockSize_)
+    getOrCreatePool()->reserve(nBlocks, nBlockSize);
+}
+
+AllocatorStats PrivatePoolResource::stats() const
+{
+  if (PagePool* pool = paHandle_.pPool_)
+    return pool->getStats();
+  return AllocatorStats();
+}
+
+//========================================================================================
+// Unittests
+//________________________________________________________________________________________
+void test_PrivatePoolResource()
+{
+  PrivatePoolResource resource;
+  RG_EXPECT(resource.stats().nPages == 0 && resource.is_equal(resource));
+  RG_EXPECT(!resource.is_equal(*std::pmr::new_delete_resource()));
+
+  // Blocks, rounded up to the alignment, share the PageChains:
+  void* b1 = resource.allocate(24, 8);
+  void* b2 = resource.allocate(20, 16);
+  void* b3 = resource.allocate(0, 1);
+  RG_EXPECT(b1 && b2 && b3 && (size_t(b2) & 15) == 0);
+  RG_EXPECT(resource.stats().nLiveBlocks == 3 && resource.stats().nFallbacks == 0);
+  resource.deallocate(b2, 20, 16);
+  RG_EXPECT(resource.allocate(32, 16) == b2); // Same chain, via the free list
+  resource.deallocate(b2, 32, 16);
+  resource.deallocate(b1, 24, 8);
+  resource.deallocate(b3, 0, 1);
+  void* b4 = resource.allocate(40, 64); // A block, even though over-aligned
+  RG_EXPECT((size_t(b4) & 63) == 0 && resource.stats().nFallbacks == 0);
+  resource.deallocate(b4, 40, 64);
+
+  // Arrays, cached or not, and over-aligned requests:
+  void* a1 = resource.allocate(1000);
+  void* a2 = resource.allocate(cnMaxCachedArrayByteSize_ + 1);
+  void* a3 = resource.allocate(64, 256);
+  RG_EXPECT(a1 && a2 && a3 && (size_t(a3) & 255) == 0);
+  RG_EXPECT(resource.stats().nFallbacks == 3);
+  resource.deallocate(a1, 1000);
+  resource.deallocate(a2, cnMaxCachedArrayByteSize_ + 1);
+  resource.deallocate(a3, 64, 256);
+  RG_EXPECT(resource.allocate(1000) == a1); // Cached
+  resource.deallocate(a1, 1000);
+
+  // With pmr containers:
+  std::pmr::list<int> l(&resource);
+  std::pmr::map<int, std::pmr::string> m(&resource);
+  for (int j = 0; j < 1000; ++j)
+  {
+    l.push_back(j);
+    m.emplace(j, "a string too long for the small-string buffer");
+  }
+  RG_EXPECT(l.size() == 1000 && m.size() == 1000 && m[999].size() > 40);
+  RG_EXPECT(resource.stats().nLiveBlocks >= 2000);
+  l.clear();
+  m.clear();
+  RG_EXPECT(resource.stats().nLiveBlocks == 0);
+  resource.trim();
+  RG_EXPECT(resource.stats().nPages == 0);
+}
+
+RG_ADD_UNITTEST2(test_PrivatePoolResource, 1);
+
+// ------------------------ End Of File --------------------------------------
+
+} // namespace rg_privateallocator
+
+#endif // RG_PRIVATEPOOLRESOURCE
@@ -0,0 +1,89 @@
+// PrivatePoolResource.h
+//
+// std::pmr::memory_resource over the PrivateAllocator<> Pages, so that std::pmr
+// containers (of a single type for all resources) get the same allocation scheme.
+//
+// Author:
+//    Radoslav Getov, getov@mail.com
+
+// ------------------------------------- #Include Guards ---------------------------------
+
+#ifndef RGCPP_PRIVATEPOOLRESOURCE_H_INCLUDED
+#define RGCPP_PRIVATEPOOLRESOURCE_H_INCLUDED
+
+// ------------------------------------- Configuration -----------------------------------
+
+// std::pmr needs C++17; with earlier standards (or defined as 0) nothing is declared.
+#ifndef RG_PRIVATEPOOLRESOURCE
+  #if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+    #define RG_PRIVATEPOOLRESOURCE 1
+  #else
+    #define RG_PRIVATEPOOLRESOURCE 0
+  #endif
+#endif
+
+#if RG_PRIVATEPOOLRESOURCE
+
+// ------------------------------------- #Includes ---------------------------------------
+
+#include "PageAllocator.h"
+#include "BackendAllocators.h"
+
+#include <memory_resource>
+
+// ------------------------------------- Definitions -------------------------------------
+
+namespace rg_privateallocator
+{
+
+//****************************************************************************************
+// Memory resource with the state of a PrivateAllocator<> clique: all the containers
+// using the resource share its (delay-created) PagePool.
+// Requests of up to cnMaxBlockSize_ bytes (and alignment) are single blocks: the byte 
+// count, rounded up to the alignment, selects the PageChain. The other requests are 
+// arrays, kept for reuse up to cnMaxCachedArrayByteSize_ (see ArrayCache); those 
+// aligned to more than cnMaxAlign go straight to the backend.
+// Like PrivateAllocator<>, it is used by one thread at a time; others may deallocate.
+// All the memory is released upon destruction, as by the std::pmr pool resources.
+//________________________________________________________________________________________
+class PrivatePoolResource : public std::pmr::memory_resource
+{
+public:
+  // The Pages and arrays come from 'backend':
+  explicit PrivatePoolResource(const BackendAllocator* backend = theBackendAllocator,
+                               const PageGrowth& growth = PageGrowth());
+
+  PrivatePoolResource(const PrivatePoolResource&) = delete;
+  PrivatePoolResource& operator=(const PrivatePoolResource&) = delete;
+
+// Same as in PrivateAllocator<>:
+  void trim();
+  void setTrimThreshold(size_t nFreeBytes);
+  void sortFreeBlocks();
+  void setSortThreshold(size_t nReturns);
+  void reserve(size_t nBlocks, size_t nBlockSize);
+  AllocatorStats stats() const;
+
+protected:
+// std::pmr::memory_resource implementation:
+  void* do_allocate(size_t nBytes, size_t nAlignment) override;
+  void do_deallocate(void* p, size_t nBytes, size_t nAlignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+  // The block size serving a request, or 0 for the non-block ones:
+  static size_t calcBlockSize(size_t nBytes, size_t nAlignment);
+  PagePool* getOrCreatePool();
+
+  const BackendAllocator* pBackend_;
+  PageGrowth growth_;
+  PageHandle paHandle_;
+};
+
+// -------------------------------- End Of File ------------------------------------------
+
+} // namespace rg_privateallocator
+
+#endif // RG_PRIVATEPOOLRESOURCE
+
+#endif // #include guard